@@ -3,32 +3,172 @@
 * Date: 5/26/2019
 * Program: keygen.c
 * This program creates a key file of specified length from the 27 allowed
-* characters
+* characters. Randomness comes from getrandom() a block at a time, and each byte
+* is mapped to a character by rejection sampling so every character is equally
+* likely. Blocks are filled by several threads and written out in order, so
+* multi-GB pads come out about as fast as the disk takes them. With -b the key is
+* raw random bytes, for byte mode clients
 **********************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#define BLOCK_SIZE (1024 * 1024)                            // characters per write
+#define ACCEPT_BELOW 243                                    // 9 * 27: bytes at or past this are thrown away
+
+// one block of output, filled by a generator and emptied by the writer
+struct slot {
+    char* buf;
+    long long block;                                        // which block it holds
+    int inUse, ready;
+};
+
+static char symbol[256];                                    // byte to character, 0 where the byte is rejected
+static long long length, blocks, nextBlock;
+static int slotCount, byteMode;
+static struct slot* slots;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
 
 void error(const char *msg) { perror(msg); exit(0); } // Error function used for reporting issues
 
+// fill n characters, pulling more random bytes whenever too many were rejected
+static void fillKey(char* out, int n, unsigned char* raw){
+    int filled = 0, want, got, i;
+    while(filled < n){
+        want = n - filled + (n - filled) / 16 + 64;         // about 5% of bytes are rejected
+        if(byteMode) want = n - filled;                     // every byte is fine as it is
+        got = getrandom(byteMode ? (unsigned char*)out + filled : raw, want, 0);
+        if(got < 0){
+            if(errno == EINTR) continue;
+            perror("keygen error: getrandom");
+            exit(1);
+        }
+        if(byteMode){
+            filled += got;
+            continue;
+        }
+        for(i = 0; i < got && filled < n; i++){
+            if(symbol[raw[i]] != 0) out[filled++] = symbol[raw[i]];
+        }
+    }
+}
+
+static void* generatorThread(void* arg){
+    unsigned char* raw = malloc(BLOCK_SIZE + BLOCK_SIZE / 16 + 64);
+    struct slot* s;
+    long long k;
+    int n;
+    (void)arg;
+
+    if(raw == NULL) error("malloc");
+    while(1){
+        pthread_mutex_lock(&lock);
+        k = nextBlock++;
+        if(k >= blocks){
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        s = &slots[k % slotCount];
+        while(s->inUse){                                    // wait for the writer to empty it
+            pthread_cond_wait(&changed, &lock);
+        }
+        s->inUse = 1;
+        s->block = k;
+        pthread_mutex_unlock(&lock);
+
+        n = k == blocks - 1 ? length - k * BLOCK_SIZE : BLOCK_SIZE;
+        fillKey(s->buf, n, raw);
+
+        pthread_mutex_lock(&lock);
+        s->ready = 1;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    }
+    free(raw);
+    return NULL;
+}
+
+static void writeAll(const char* buf, long long len){
+    ssize_t n;
+    while(len > 0){
+        n = write(STDOUT_FILENO, buf, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0){
+            perror("keygen error: writing key");
+            exit(1);
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
 int main(int argc, char *argv[]){
-    if(argc != 2){
+    char charArray[27] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";     // 27 allowed chars
+    int threads = sysconf(_SC_NPROCESSORS_ONLN), opt, i, n;
+    char* end;
+    struct slot* s;
+    pthread_t thread;
+    long long k;
+
+    while((opt = getopt(argc, argv, "t:b")) != -1){
+        if(opt == 't') threads = atoi(optarg);
+        else if(opt == 'b') byteMode = 1;
+        else error("ERROR usage: keygen [-b] [-t threads] keylength");
+    }
+    if(optind != argc - 1){
         error("ERROR key length too short.");
         exit(0);
     }
-    
-    srand(time(0));                                         // random seed
-    char charArray[27] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";     // 27 allowed chars
-    const int length = atoi(argv[1]);
-    char key[length + 1];                                   // char array to hold letters
-    int i;
-    for(i = 0; i < length; i++){
-        key[i] = charArray[rand() % 27];                    // randomly assign letters to key
+    errno = 0;
+    length = strtoll(argv[optind], &end, 10);
+    if(errno != 0 || *end != '\0' || length < 0){
+        error("ERROR key length too short.");
+    }
+    if(threads < 1) threads = 1;
+
+    for(i = 0; i < ACCEPT_BELOW; i++){
+        symbol[i] = charArray[i % 27];                      // each char gets exactly 9 byte values
+    }
+
+    blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if(threads > blocks) threads = blocks;
+    slotCount = threads * 2;                                // generators can run a block ahead of the writer
+    slots = calloc(slotCount > 0 ? slotCount : 1, sizeof(struct slot));
+    if(slots == NULL) error("malloc");
+    for(i = 0; i < slotCount; i++){
+        slots[i].buf = malloc(BLOCK_SIZE);
+        if(slots[i].buf == NULL) error("malloc");
+    }
+    for(i = 0; i < threads; i++){
+        if(pthread_create(&thread, NULL, generatorThread, NULL) != 0) error("pthread_create");
+        pthread_detach(thread);
+    }
+
+    // write the blocks in order as they come in
+    for(k = 0; k < blocks; k++){
+        s = &slots[k % slotCount];
+        pthread_mutex_lock(&lock);
+        while(!s->ready || s->block != k){
+            pthread_cond_wait(&changed, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+
+        n = k == blocks - 1 ? length - k * BLOCK_SIZE : BLOCK_SIZE;
+        writeAll(s->buf, n);
+
+        pthread_mutex_lock(&lock);
+        s->ready = 0;
+        s->inUse = 0;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
     }
-    key[length] = '\0';
-    printf("%s\n", key);                                    // last char printed is newline
+    if(!byteMode) writeAll("\n", 1);                        // last char printed is newline
 
     return 0;
-}
\ No newline at end of file
+}
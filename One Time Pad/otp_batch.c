@@ -0,0 +1,350 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_batch.c
+* Description: batch mode for otp_enc and otp_dec. Text/key pairs come from a
+* manifest (-b) or a directory (-d) and are spread over a small pool of stream
+* connections, each opened and handshaken once (and dealt out over the daemons
+* when a list of ports is given). On every connection one thread pipelines
+* requests out while another writes each answer to that file's own output, so a
+* file costs a few system calls rather than a process and a connect. Inputs are
+* sent from their mappings and answers spliced into the outputs, as in otp_client.c
+**********************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "otp_client.h"
+#include "otp_proto.h"
+
+// one file to run through the daemon
+struct batchJob {
+	char *textPath, *keyPath, *outPath;
+	int outFD;
+	int failed;										// set once the file turned out bad part way through
+};
+
+// a pooled connection and the jobs it has sent but not yet seen answered
+struct batchConn {
+	int socketFD;
+	int packed;										// negotiated with this connection's daemon
+	int window[BATCH_WINDOW];						// job indexes, oldest first
+	int head, count;
+	int sendDone;
+	pthread_t sender, receiver;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+static struct batchJob* jobs;
+static int jobCount, jobCap;
+static int nextJob, failures;
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void error(const char *msg, int exitValue){
+	perror(msg); exit(exitValue); 					// Error function used for reporting issues
+}
+
+static char* joinPath(const char* a, const char* b, const char* c){
+	char* path = malloc(strlen(a) + strlen(b) + strlen(c) + 1);
+	if(path == NULL) error("malloc", 1);
+	strcpy(path, a);
+	strcat(path, b);
+	strcat(path, c);
+	return path;
+}
+
+static int endsWith(const char* s, const char* suffix){
+	int n = strlen(s), m = strlen(suffix);
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// output defaults to the input name plus ".cipher" or ".plaintext"
+static void addJob(const char* textPath, const char* keyPath, const char* outPath){
+	struct batchJob* job;
+	if(jobCount == jobCap){
+		jobCap = jobCap ? jobCap * 2 : 64;
+		jobs = realloc(jobs, sizeof(struct batchJob) * jobCap);
+		if(jobs == NULL) error("malloc", 1);
+	}
+	job = &jobs[jobCount++];
+	job->textPath = strdup(textPath);
+	job->keyPath = strdup(keyPath);
+	job->outPath = outPath != NULL ? strdup(outPath) : joinPath(textPath, ".", activeClient->outputName);
+	if(job->textPath == NULL || job->keyPath == NULL || job->outPath == NULL) error("malloc", 1);
+	job->outFD = -1;
+	job->failed = 0;
+}
+
+/* Manifest lines are "textfile keyfile [outputfile]" separated by whitespace.
+   Blank lines and lines starting with # are skipped */
+static void readManifest(const char* path){
+	FILE* manifest = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	char *line = NULL, *text, *key, *out, *save;
+	size_t size = 0;
+	int lineNumber = 0;
+
+	if(manifest == NULL){
+		fprintf(stderr, "%s error: opening manifest '%s': %s\n", activeClient->name, path, strerror(errno));
+		exit(1);
+	}
+	while(getline(&line, &size, manifest) != -1){
+		lineNumber++;
+		text = strtok_r(line, " \t\r\n", &save);
+		if(text == NULL || text[0] == '#') continue;
+		key = strtok_r(NULL, " \t\r\n", &save);
+		out = strtok_r(NULL, " \t\r\n", &save);
+		if(key == NULL || strtok_r(NULL, " \t\r\n", &save) != NULL){
+			fprintf(stderr, "%s error: manifest line %d: expected %sfile keyfile [outputfile]\n", activeClient->name, lineNumber, activeClient->inputName);
+			exit(1);
+		}
+		addJob(text, key, out);
+	}
+	free(line);
+	if(manifest != stdin) fclose(manifest);
+}
+
+static int byTextPath(const void* a, const void* b){
+	return strcmp(((const struct batchJob*)a)->textPath, ((const struct batchJob*)b)->textPath);
+}
+
+/* Every regular file in the directory is an input, except keys and earlier
+   outputs. The key for X is X.key, or X with its extension swapped for .key */
+static void readDirectory(const char* path){
+	DIR* dir = opendir(path);
+	struct dirent* entry;
+	struct stat info;
+	char *textPath, *keyPath, *outSuffix, *dot;
+
+	if(dir == NULL){
+		fprintf(stderr, "%s error: opening directory '%s': %s\n", activeClient->name, path, strerror(errno));
+		exit(1);
+	}
+	outSuffix = joinPath(".", activeClient->outputName, "");
+	while((entry = readdir(dir)) != NULL){
+		if(entry->d_name[0] == '.' || endsWith(entry->d_name, ".key") || endsWith(entry->d_name, outSuffix)) continue;
+		textPath = joinPath(path, "/", entry->d_name);
+		if(stat(textPath, &info) < 0 || !S_ISREG(info.st_mode)){
+			free(textPath);
+			continue;
+		}
+		keyPath = joinPath(textPath, ".key", "");
+		dot = strrchr(entry->d_name, '.');
+		if(access(keyPath, R_OK) < 0 && dot != NULL){
+			free(keyPath);
+			textPath[strlen(path) + 1 + (dot - entry->d_name)] = '\0';		// drop the extension for a moment
+			keyPath = joinPath(textPath, ".key", "");
+			textPath[strlen(textPath)] = '.';
+		}
+		addJob(textPath, keyPath, NULL);
+		free(textPath);
+		free(keyPath);
+	}
+	closedir(dir);
+	free(outSuffix);
+	qsort(jobs, jobCount, sizeof(struct batchJob), byTextPath);		// same order every run
+}
+
+static int takeJob(void){
+	int i;
+	pthread_mutex_lock(&jobLock);
+	i = nextJob < jobCount ? nextJob++ : -1;
+	pthread_mutex_unlock(&jobLock);
+	return i;
+}
+
+static void jobFailed(void){
+	pthread_mutex_lock(&jobLock);
+	failures++;
+	pthread_mutex_unlock(&jobLock);
+}
+
+/* Pipeline jobs down one connection until there are none left. A file that fails
+   on its first chunk never goes out; one that fails later is cut short with an
+   empty final chunk and its partial output removed by the receiver */
+static void* senderThread(void* arg){
+	struct batchConn* conn = arg;
+	struct pairReader pair;
+	struct batchJob* job;
+	char *textBuf = malloc(STREAM_CHUNK), *keyBuf = malloc(STREAM_CHUNK);
+	int i, length, last;
+
+	if(textBuf == NULL || keyBuf == NULL) error("malloc", 1);
+	while((i = takeJob()) >= 0){
+		job = &jobs[i];
+		if(openPair(&pair, job->textPath, job->keyPath) < 0){
+			jobFailed();
+			continue;
+		}
+		length = nextChunk(&pair, textBuf, keyBuf);
+		if(length >= 0){
+			job->outFD = open(job->outPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if(job->outFD < 0){
+				fprintf(stderr, "%s error: opening output '%s': %s\n", activeClient->name, job->outPath, strerror(errno));
+			}
+		}
+		if(length < 0 || job->outFD < 0){
+			closePair(&pair);
+			jobFailed();
+			continue;
+		}
+
+		pthread_mutex_lock(&conn->lock);								// wait for room in the window
+		while(conn->count == BATCH_WINDOW){
+			pthread_cond_wait(&conn->changed, &conn->lock);
+		}
+		conn->window[(conn->head + conn->count) % BATCH_WINDOW] = i;
+		conn->count++;
+		pthread_cond_broadcast(&conn->changed);
+		pthread_mutex_unlock(&conn->lock);
+
+		last = pair.text.done;
+		while(1){
+			if(sendChunk(conn->socketFD, conn->packed, i + 1, &pair, textBuf, keyBuf, length, last, NULL) < 0){
+				fprintf(stderr, "%s error: writing to socket: %s\n", activeClient->name, strerror(errno));
+				exit(2);
+			}
+			if(last) break;
+			length = nextChunk(&pair, textBuf, keyBuf);
+			if(length < 0){
+				pthread_mutex_lock(&conn->lock);
+				job->failed = 1;
+				pthread_mutex_unlock(&conn->lock);
+				length = 0;
+				last = 1;
+			}
+			else{
+				last = pair.text.done;
+			}
+		}
+		closePair(&pair);
+	}
+
+	shutdown(conn->socketFD, SHUT_WR);									// no more requests
+	pthread_mutex_lock(&conn->lock);
+	conn->sendDone = 1;
+	pthread_cond_broadcast(&conn->changed);
+	pthread_mutex_unlock(&conn->lock);
+	free(textBuf);
+	free(keyBuf);
+	return NULL;
+}
+
+// write each answered chunk to the output of the oldest job still in flight
+static void* receiverThread(void* arg){
+	struct batchConn* conn = arg;
+	struct streamHeader header;
+	struct batchJob* job;
+	uint32_t length, flags;
+	char* output = malloc(RESULT_BUFFER);
+	struct resultSink sink = SINK_INIT;
+	int i, failed, copied;
+
+	if(output == NULL) error("malloc", 1);
+	while(1){
+		pthread_mutex_lock(&conn->lock);
+		while(conn->count == 0 && !conn->sendDone){
+			pthread_cond_wait(&conn->changed, &conn->lock);
+		}
+		if(conn->count == 0){
+			pthread_mutex_unlock(&conn->lock);
+			break;
+		}
+		i = conn->window[conn->head];
+		pthread_mutex_unlock(&conn->lock);
+		job = &jobs[i];
+		openSink(&sink, job->outFD);
+
+		do{
+			if(recvAll(conn->socketFD, &header, sizeof(header)) < 0){
+				fprintf(stderr, "%s error: reading %s from socket: connection closed\n", activeClient->name, activeClient->outputName);
+				exit(2);
+			}
+			length = ntohl(header.length);
+			flags = ntohl(header.flags);
+			if(flags & STREAM_ERROR){
+				if(length > STREAM_CHUNK - 1) length = STREAM_CHUNK - 1;
+				if(recvAll(conn->socketFD, output, length) < 0) length = 0;
+				fprintf(stderr, "%s error: daemon reported: %.*s\n", activeClient->name, (int)length, output);
+				exit(2);
+			}
+			copied = ntohl(header.id) != (uint32_t)i + 1 || length > STREAM_CHUNK ? -1 :
+				copyResult(conn->socketFD, conn->packed, &sink, output, length);
+			if(copied == -1){
+				fprintf(stderr, "%s error: reading %s from socket: bad chunk\n", activeClient->name, activeClient->outputName);
+				exit(2);
+			}
+			if(copied < 0){
+				fprintf(stderr, "%s error: writing '%s': %s\n", activeClient->name, job->outPath, strerror(errno));
+				exit(1);
+			}
+		}while(!(flags & STREAM_LAST));
+
+		pthread_mutex_lock(&conn->lock);
+		failed = job->failed;
+		conn->head = (conn->head + 1) % BATCH_WINDOW;
+		conn->count--;
+		pthread_cond_broadcast(&conn->changed);
+		pthread_mutex_unlock(&conn->lock);
+
+		if(!failed && !byteMode) writeAll(job->outFD, "\n", 1);		// last char of each output is newline
+		close(job->outFD);
+		if(failed){
+			unlink(job->outPath);										// don't leave half a file behind
+			jobFailed();
+		}
+	}
+	closeSink(&sink);
+	free(output);
+	return NULL;
+}
+
+/* Run every job over a pool of connections. Exits 1 if any file failed, like a
+   single run would, and 2 if the daemon could not be used at all */
+int runBatch(const char* manifest, const char* directory, int connections, const char* port){
+	struct batchConn* pool;
+	char** ports;
+	int i, portCount;
+
+	if(manifest != NULL) readManifest(manifest);
+	else readDirectory(directory);
+	if(jobCount == 0) return 0;
+	ports = splitPorts(port, &portCount);
+	if(connections < portCount) connections = portCount;					// at least one per daemon
+	if(connections > jobCount) connections = jobCount;
+
+	pool = calloc(connections, sizeof(struct batchConn));
+	if(pool == NULL) error("malloc", 1);
+	for(i = 0; i < connections; i++){
+		pool[i].socketFD = openStream(ports[i % portCount], byteMode ? BYTES_OPTION : STREAM_OPTION, &pool[i].packed);
+		pthread_mutex_init(&pool[i].lock, NULL);
+		pthread_cond_init(&pool[i].changed, NULL);
+		if(pthread_create(&pool[i].receiver, NULL, receiverThread, &pool[i]) != 0 ||
+				pthread_create(&pool[i].sender, NULL, senderThread, &pool[i]) != 0){
+			error("pthread_create", 2);
+		}
+	}
+	for(i = 0; i < connections; i++){
+		pthread_join(pool[i].sender, NULL);
+		pthread_join(pool[i].receiver, NULL);
+		close(pool[i].socketFD); 										// Close the socket
+	}
+
+	for(i = 0; i < jobCount; i++){
+		free(jobs[i].textPath);
+		free(jobs[i].keyPath);
+		free(jobs[i].outPath);
+	}
+	free(jobs);
+	free(pool);
+	free(ports);
+	return failures > 0 ? 1 : 0;
+}
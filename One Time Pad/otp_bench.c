@@ -0,0 +1,344 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_bench.c
+* Description: load generator for otp_enc_d and otp_dec_d. Some number of client
+* threads send synthetic requests of a fixed size, either as fresh legacy
+* connections (what one otp_enc run costs) or down one stream connection each,
+* optionally paced to a total request rate; packed mode is stream mode with the
+* packed wire format, packing and unpacking included in the time, and header
+* mode is a connection per request opened with a requestHeader instead of the
+* handshake and its echo. Latency is measured from when each
+* request was due to go out, so a slow daemon can't hide its queueing delay, and
+* the results are printed as one line of JSON. benchscript runs it over a sweep
+**********************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include "otp_proto.h"
+#include "otp_cipher.h"
+
+// settings from the command line, shared by every client thread
+struct benchConfig {
+	const char* op;									// "encrypt" or "decrypt"
+	int stream;										// persistent stream connection rather than one per request
+	int packed;										// stream mode with the packed wire format
+	int header;										// a connection per request, in header mode
+	int fastOpen;									// -F: TCP Fast Open
+	int clients;
+	int size;										// payload bytes per request
+	long long requests;								// per client, unless seconds is set
+	double seconds;
+	double rate;									// total requests per second, 0 for as fast as possible
+	struct sockaddr_storage address;				// loopback TCP, or a Unix socket with -u
+	socklen_t addressLength;
+};
+
+struct benchClient {
+	int index;
+	unsigned* latency;								// microseconds, one per request
+	long long count, cap;
+	long long errors;
+};
+
+static struct benchConfig config;
+static struct timespec startTime;
+
+static void error(const char *msg, int exitValue) { perror(msg); exit(exitValue); } // Error function used for reporting issues
+
+static double now(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// more is set for all but the last piece of a message, as the real clients do
+static int sendAll(int fd, const void* buf, int len, int more){
+	int total = 0, n;
+	while(total < len){
+		n = send(fd, (const char*)buf + total, len - total, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0) return -1;
+		total += n;
+	}
+	return total;
+}
+
+static int recvAll(int fd, void* buf, int len){
+	int total = 0, n;
+	while(total < len){
+		n = recv(fd, (char*)buf + total, len - total, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return -1;
+		total += n;
+	}
+	return total;
+}
+
+// connect the way the real clients do; -1 on any failure
+static int connectDaemon(void){
+	int fd = socket(config.address.ss_family, SOCK_STREAM, 0), yes = 1;
+	if(fd < 0) return -1;
+	if(config.address.ss_family == AF_INET){
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+		if(config.fastOpen) setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &yes, sizeof(int));
+	}
+	if(connect(fd, (struct sockaddr*)&config.address, config.addressLength) < 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// connect and trade handshakes; -1 on any failure
+static int openConnection(const char* option){
+	char hello[64], echo[64];
+	int fd, len;
+
+	if((fd = connectDaemon()) < 0) return -1;
+	len = snprintf(hello, sizeof(hello), option != NULL ? "%s %s" : "%s", config.op, option) + 1;
+	if(sendAll(fd, hello, len, 0) < 0 || recvAll(fd, echo, len) < 0 || memcmp(hello, echo, len) != 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// one request the way otp_enc used to do it: connect, size, text, key, answer
+static int legacyRequest(const char* text, const char* key, char* out){
+	int fd = openConnection(NULL), size = config.size + 1, ok;
+	if(fd < 0) return -1;
+	ok = sendAll(fd, &size, sizeof(size), 1) >= 0 && sendAll(fd, text, size, 1) >= 0 &&
+		sendAll(fd, key, size, 0) >= 0 && recvAll(fd, out, size) >= 0;
+	close(fd);
+	return ok ? 0 : -1;
+}
+
+// one request in header mode: the header goes out with the request, and one comes back with the answer
+static int headerRequest(const char* text, const char* key, char* out){
+	struct requestHeader header;
+	int fd = connectDaemon(), ok;
+	if(fd < 0) return -1;
+	header.magic = htonl(REQUEST_MAGIC);
+	header.version = REQUEST_VERSION;
+	header.operation = strcmp(config.op, "encrypt") == 0 ? REQUEST_ENCRYPT : REQUEST_DECRYPT;
+	header.flags = 0;
+	header.length = htobe64(config.size);
+	ok = sendAll(fd, &header, sizeof(header), 1) >= 0 && sendAll(fd, text, config.size, 1) >= 0 &&
+		sendAll(fd, key, config.size, 0) >= 0 && recvAll(fd, &header, sizeof(header)) >= 0 &&
+		header.flags == 0 && be64toh(header.length) == (uint64_t)config.size && recvAll(fd, out, config.size) >= 0;
+	close(fd);
+	return ok ? 0 : -1;
+}
+
+/* One request on a stream connection, a chunk at a time. In packed mode text and
+   key go through scratch, which holds two packed chunks, and so does the answer */
+static int streamRequest(int fd, uint32_t id, const char* text, const char* key, char* out, char* scratch){
+	struct streamHeader header;
+	int sent = 0, length, wireLength;
+
+	do{
+		length = config.size - sent < STREAM_CHUNK ? config.size - sent : STREAM_CHUNK;
+		wireLength = config.packed ? PACKED_SIZE(length) : length;
+		header.id = htonl(id);
+		header.length = htonl(length);
+		header.flags = htonl(sent + length == config.size ? STREAM_LAST : 0);
+		if(config.packed){
+			otpPack(scratch, text + sent, length);
+			otpPack(scratch + wireLength, key + sent, length);
+		}
+		if(sendAll(fd, &header, sizeof(header), 1) < 0 ||
+				sendAll(fd, config.packed ? scratch : text + sent, wireLength, 1) < 0 ||
+				sendAll(fd, config.packed ? scratch + wireLength : key + sent, wireLength, 0) < 0 ||
+				recvAll(fd, &header, sizeof(header)) < 0 ||
+				(ntohl(header.flags) & STREAM_ERROR) || ntohl(header.length) != (uint32_t)length ||
+				recvAll(fd, config.packed ? scratch : out + sent, wireLength) < 0){
+			return -1;
+		}
+		if(config.packed) otpUnpack(out + sent, scratch, length);
+		sent += length;
+	}while(sent < config.size);
+	return 0;
+}
+
+static void record(struct benchClient* c, double seconds){
+	if(c->count == c->cap){
+		c->cap = c->cap ? c->cap * 2 : 4096;
+		c->latency = realloc(c->latency, sizeof(unsigned) * c->cap);
+		if(c->latency == NULL) error("malloc", 1);
+	}
+	c->latency[c->count++] = seconds * 1e6;
+}
+
+static void* clientThread(void* arg){
+	static const char charArray[27] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+	struct benchClient* c = arg;
+	char *text = malloc(config.size + 1), *key = malloc(config.size + 1), *out = malloc(config.size + 1);
+	char* scratch = malloc(2 * PACKED_SIZE(STREAM_CHUNK));
+	double interval = config.rate > 0 ? config.clients / config.rate : 0;
+	double start = startTime.tv_sec + startTime.tv_nsec / 1e9, due, wait;
+	unsigned seed = c->index * 7919 + 1;
+	struct timespec pause;
+	long long i;
+	int fd = -1;
+
+	if(text == NULL || key == NULL || out == NULL || scratch == NULL) error("malloc", 1);
+	for(i = 0; i < config.size; i++){
+		text[i] = charArray[rand_r(&seed) % 27];
+		key[i] = charArray[rand_r(&seed) % 27];
+	}
+	text[config.size] = key[config.size] = '\0';
+
+	due = start + interval * c->index / config.clients;			// stagger paced clients
+	for(i = 0; config.seconds > 0 ? now() - start < config.seconds : i < config.requests; i++){
+		if(interval > 0){
+			wait = due - now();
+			if(wait > 0){
+				pause.tv_sec = wait;
+				pause.tv_nsec = (wait - pause.tv_sec) * 1e9;
+				nanosleep(&pause, NULL);
+			}
+		}
+		else{
+			due = now();
+		}
+		if(config.stream && fd < 0) fd = openConnection(config.packed ? STREAM_OPTION " " PACKED_OPTION : STREAM_OPTION);
+		if(config.stream ? fd < 0 || streamRequest(fd, i + 1, text, key, out, scratch) < 0 :
+				(config.header ? headerRequest(text, key, out) : legacyRequest(text, key, out)) < 0){
+			c->errors++;
+			if(fd >= 0) close(fd);
+			fd = -1;											// start over on a new connection
+		}
+		else{
+			record(c, now() - due);
+		}
+		due += interval;
+	}
+	if(fd >= 0) close(fd);
+	free(text);
+	free(key);
+	free(out);
+	free(scratch);
+	return NULL;
+}
+
+static int compareUnsigned(const void* a, const void* b){
+	unsigned x = *(const unsigned*)a, y = *(const unsigned*)b;
+	return x < y ? -1 : x > y;
+}
+
+static unsigned percentile(const unsigned* sorted, long long n, double p){
+	long long i = (long long)(p * n);
+	if(n == 0) return 0;
+	return sorted[i < n ? i : n - 1];
+}
+
+static void usage(const char* prog){
+	fprintf(stderr, "USAGE: %s [-o encrypt|decrypt] [-m legacy|header|stream|packed] [-c clients] [-s size] "
+		"[-n requests_per_client | -d seconds] [-r total_rate] [-F] port | -u socketpath\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]){
+	struct benchClient* clients;
+	pthread_t* threads;
+	unsigned* all;
+	long long total = 0, errors = 0, i, j;
+	double elapsed, sum = 0;
+	struct sockaddr_in* tcp = (struct sockaddr_in*)&config.address;
+	struct sockaddr_un* local = (struct sockaddr_un*)&config.address;
+	int opt, unixSocket = 0;
+
+	config.op = "encrypt";
+	config.stream = 1;
+	config.clients = 8;
+	config.size = 1024;
+	config.requests = 1000;
+	while((opt = getopt(argc, argv, "o:m:c:s:n:d:r:Fu")) != -1){
+		switch(opt){
+			case 'o': config.op = optarg; break;
+			case 'm':
+				config.packed = strcmp(optarg, "packed") == 0;
+				config.header = strcmp(optarg, "header") == 0;
+				config.stream = strcmp(optarg, "stream") == 0 || config.packed;
+				if(!config.stream && !config.header && strcmp(optarg, "legacy") != 0) usage(argv[0]);
+				break;
+			case 'c': config.clients = atoi(optarg); break;
+			case 's': config.size = atoi(optarg); break;
+			case 'n': config.requests = atoll(optarg); break;
+			case 'd': config.seconds = atof(optarg); break;
+			case 'r': config.rate = atof(optarg); break;
+			case 'F': config.fastOpen = 1; break;
+			case 'u': unixSocket = 1; break;
+			default: usage(argv[0]);
+		}
+	}
+	if(optind != argc - 1 || config.clients < 1 || config.size < 1 || config.size >= (1 << 24) ||
+			(strcmp(config.op, "encrypt") != 0 && strcmp(config.op, "decrypt") != 0)){
+		usage(argv[0]);
+	}
+	if(unixSocket){
+		if(strlen(argv[optind]) >= sizeof(local->sun_path)) usage(argv[0]);
+		local->sun_family = AF_UNIX;
+		strcpy(local->sun_path, argv[optind]);
+		config.addressLength = sizeof(*local);
+	}
+	else{
+		tcp->sin_family = AF_INET;
+		tcp->sin_port = htons(atoi(argv[optind]));
+		tcp->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		config.addressLength = sizeof(*tcp);
+	}
+
+	clients = calloc(config.clients, sizeof(struct benchClient));
+	threads = malloc(sizeof(pthread_t) * config.clients);
+	if(clients == NULL || threads == NULL) error("malloc", 1);
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	for(i = 0; i < config.clients; i++){
+		clients[i].index = i;
+		if(pthread_create(&threads[i], NULL, clientThread, &clients[i]) != 0) error("pthread_create", 1);
+	}
+	for(i = 0; i < config.clients; i++){
+		pthread_join(threads[i], NULL);
+		total += clients[i].count;
+		errors += clients[i].errors;
+	}
+	elapsed = now() - (startTime.tv_sec + startTime.tv_nsec / 1e9);
+
+	// pool every client's latencies for the percentiles
+	all = malloc(sizeof(unsigned) * (total > 0 ? total : 1));
+	if(all == NULL) error("malloc", 1);
+	for(i = 0, total = 0; i < config.clients; i++){
+		for(j = 0; j < clients[i].count; j++){
+			all[total++] = clients[i].latency[j];
+			sum += clients[i].latency[j];
+		}
+		free(clients[i].latency);
+	}
+	qsort(all, total, sizeof(unsigned), compareUnsigned);
+
+	printf("{\"op\":\"%s\",\"mode\":\"%s\",\"clients\":%d,\"size\":%d,\"rate\":%.0f,"
+		"\"transport\":\"%s\",\"requests\":%lld,\"errors\":%lld,\"seconds\":%.3f,\"requests_per_sec\":%.1f,\"mb_per_sec\":%.2f,"
+		"\"latency_us\":{\"mean\":%.1f,\"p50\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u}}\n",
+		config.op, config.packed ? "packed" : config.stream ? "stream" : config.header ? "header" : "legacy", config.clients, config.size, config.rate,
+		unixSocket ? "unix" : "tcp", total, errors, elapsed, total / elapsed, total * (double)config.size / elapsed / 1e6,
+		total > 0 ? sum / total : 0, percentile(all, total, 0.50), percentile(all, total, 0.99),
+		percentile(all, total, 0.999), total > 0 ? all[total - 1] : 0);
+
+	free(all);
+	free(clients);
+	free(threads);
+	return errors > 0 ? 2 : 0;
+}
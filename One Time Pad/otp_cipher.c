@@ -0,0 +1,520 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_cipher.c
+* Description: encrypt and decrypt kernels for the 27 character alphabet. Chars
+* map to 0-26 ('A' is 0, ' ' is 26), so a sum is at most 53 and one conditional
+* subtract of 27 replaces the % 27. Both steps are an unsigned min, which the
+* vector versions do 16 (SSE2) or 32 (AVX2) chars at a time. Set OTP_KERNEL to
+* scalar, sse2 or avx2 to force a particular one; any other value is reported
+* and ignored. Every kernel checks that text and key are in the alphabet in the
+* same pass, on the vectors it has already loaded, and stops at the first char
+* that isn't. Byte mode is a plain XOR with
+* the same three versions. The packed wire format (otp_proto.h) gets pack and
+* unpack kernels too: 5 bit values, eight to a 40 bit group, which the vector
+* versions build and split with multiplies and shifts, two or four groups a step
+**********************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "otp_cipher.h"
+#include "otp_proto.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OTP_X86 1
+#endif
+
+typedef size_t (*kernelFunc)(char* out, const char* a, const char* b, size_t n);
+typedef size_t (*validateFunc)(const char* text, size_t n);
+typedef void (*packFunc)(char* out, const char* in, size_t n);
+
+/* ---------------------------------------------------------------------------
+   Scalar fallback: also finishes the tail the vector loops leave behind
+   --------------------------------------------------------------------------- */
+
+// char to 0-26: ' ' - 'A' wraps past 26 and is clamped to it
+static inline unsigned symbolValue(unsigned char c){
+	unsigned char v = c - 'A';
+	return v < 26 ? v : 26;
+}
+
+static inline int validSymbol(unsigned char c){
+	return (unsigned char)(c - 'A') < 26 || c == ' ';
+}
+
+static size_t validateScalar(const char* text, size_t n){
+	size_t i;
+	for(i = 0; i < n && validSymbol(text[i]); i++);
+	return i;
+}
+
+// the vector loops found a bad char somewhere in the first n of text or key: where
+static size_t firstInvalid(const char* text, const char* key, size_t n){
+	size_t t = validateScalar(text, n), k = validateScalar(key, n);
+	return t < k ? t : k;
+}
+
+static size_t encryptScalar(char* out, const char* text, const char* key, size_t n){
+	static const char charArray[27] = OTP_ALPHABET;
+	unsigned d;
+	size_t i;
+	for(i = 0; i < n; i++){
+		if(!validSymbol(text[i]) || !validSymbol(key[i])) return i;
+		d = symbolValue(text[i]) + symbolValue(key[i]);		// encryption formula
+		if(d >= 27) d -= 27;									// fold back into 0-26
+		out[i] = charArray[d];
+	}
+	return n;
+}
+
+static size_t decryptScalar(char* out, const char* cipher, const char* key, size_t n){
+	static const char charArray[27] = OTP_ALPHABET;
+	unsigned d;
+	size_t i;
+	for(i = 0; i < n; i++){
+		if(!validSymbol(cipher[i]) || !validSymbol(key[i])) return i;
+		d = symbolValue(cipher[i]) + 27 - symbolValue(key[i]);	// decryption formula, kept non-negative
+		if(d >= 27) d -= 27;
+		out[i] = charArray[d];
+	}
+	return n;
+}
+
+// byte mode: 8 bytes at a time, memcpy keeps the loads legal at any alignment; every byte is valid
+static size_t xorScalar(char* out, const char* data, const char* key, size_t n){
+	unsigned long long d, k;
+	size_t i;
+	for(i = 0; i + 8 <= n; i += 8){
+		memcpy(&d, data + i, 8);
+		memcpy(&k, key + i, 8);
+		d ^= k;
+		memcpy(out + i, &d, 8);
+	}
+	for(; i < n; i++){
+		out[i] = data[i] ^ key[i];
+	}
+	return n;
+}
+
+// eight values to a group, the first in the low bits; a short last group takes only the bytes it needs
+static void packScalar(char* packed, const char* text, size_t n){
+	unsigned char* out = (unsigned char*)packed;
+	unsigned long long bits;
+	size_t i, j, count, bytes;
+	for(i = 0; i < n; i += 8){
+		count = n - i < 8 ? n - i : 8;
+		bits = 0;
+		for(j = 0; j < count; j++){
+			bits |= (unsigned long long)symbolValue(text[i + j]) << (5 * j);
+		}
+		bytes = PACKED_SIZE(count);
+		for(j = 0; j < bytes; j++){
+			*out++ = bits >> (8 * j);								// a group is read before any of it is written
+		}
+	}
+}
+
+static void unpackScalar(char* text, const char* packed, size_t n){
+	static const char symbols[33] = OTP_ALPHABET "\\]^_`";		// 27-31 aren't symbols: the kernels refuse them
+	const unsigned char* in = (const unsigned char*)packed;
+	unsigned long long bits;
+	size_t i, j, count, bytes;
+	for(i = 0; i < n; i += 8){
+		count = n - i < 8 ? n - i : 8;
+		bytes = PACKED_SIZE(count);
+		bits = 0;
+		for(j = 0; j < bytes; j++){
+			bits |= (unsigned long long)*in++ << (8 * j);
+		}
+		for(j = 0; j < count; j++){
+			text[i + j] = symbols[(bits >> (5 * j)) & 31];
+		}
+	}
+}
+
+#ifdef OTP_X86
+/* ---------------------------------------------------------------------------
+   SSE2: 16 chars per step. Same steps as the scalar code, done lane-wise, with
+   the alphabet check folded into the char to value step:
+     v = c - 'A' is 0-25 for a letter and 0xDF for ' '
+     v' = v + (v - 25), both saturating, leaves a letter alone and puts '[' (26)
+     up with the rest of the non-letters at 27 or more
+     value = min(v', (v ^ 0xDF) + 26 saturating), so a letter keeps v, ' ' gets
+     26 and anything else comes out 27 or more
+   then fold = min(v, v - 27), and 26 -> ' ' else + 'A'. The ciphering loops
+   work in blocks of four vectors and look at the largest value in a block once,
+   before storing any of it, so the check costs one branch per block and a bad
+   block's text is still there (even when out aliases it) for firstInvalid() to
+   find where
+   --------------------------------------------------------------------------- */
+
+static inline __m128i toValue128(__m128i c){
+	__m128i v = _mm_sub_epi8(c, _mm_set1_epi8('A'));
+	__m128i letter = _mm_adds_epu8(v, _mm_subs_epu8(v, _mm_set1_epi8(25)));
+	return _mm_min_epu8(letter, _mm_adds_epu8(_mm_xor_si128(v, _mm_set1_epi8((char)0xDF)), _mm_set1_epi8(26)));
+}
+
+static inline int allValid128(__m128i largest){
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(largest, _mm_set1_epi8(26)), largest)) == 0xFFFF;
+}
+
+// v in 0-53: below 27, v - 27 wraps high and min keeps v
+static inline __m128i fold128(__m128i v){
+	return _mm_min_epu8(v, _mm_sub_epi8(v, _mm_set1_epi8(27)));
+}
+
+static inline __m128i toChar128(__m128i v){
+	__m128i isSpace = _mm_cmpeq_epi8(v, _mm_set1_epi8(26));
+	__m128i c = _mm_add_epi8(v, _mm_set1_epi8('A'));
+	return _mm_or_si128(_mm_andnot_si128(isSpace, c), _mm_and_si128(isSpace, _mm_set1_epi8(' ')));
+}
+
+__attribute__((target("sse2")))
+static size_t validateSSE2(const char* text, size_t n){
+	size_t i;
+	for(i = 0; i + 16 <= n; i += 16){
+		if(!allValid128(toValue128(_mm_loadu_si128((const __m128i*)(text + i))))) break;
+	}
+	return i + validateScalar(text + i, n - i);
+}
+
+/* Cipher one block of count vectors (4, or 1 for the tail): load, check, and only
+   then combine and store. 0 if the block has a bad char, with nothing stored */
+__attribute__((target("sse2")))
+static inline int cipherBlock128(char* out, const char* a, const char* b, int count, int decrypt){
+	__m128i x[4], y[4], largest = _mm_setzero_si128();
+	int j;
+	for(j = 0; j < count; j++){
+		x[j] = toValue128(_mm_loadu_si128((const __m128i*)(a + 16 * j)));
+		y[j] = toValue128(_mm_loadu_si128((const __m128i*)(b + 16 * j)));
+		largest = _mm_max_epu8(largest, _mm_max_epu8(x[j], y[j]));
+	}
+	if(!allValid128(largest)) return 0;
+	for(j = 0; j < count; j++){
+		if(decrypt) x[j] = _mm_add_epi8(x[j], _mm_sub_epi8(_mm_set1_epi8(27), y[j]));	// c + (27 - k) stays positive
+		else x[j] = _mm_add_epi8(x[j], y[j]);
+		_mm_storeu_si128((__m128i*)(out + 16 * j), toChar128(fold128(x[j])));
+	}
+	return 1;
+}
+
+__attribute__((target("sse2")))
+static size_t encryptSSE2(char* out, const char* text, const char* key, size_t n){
+	size_t i;
+	for(i = 0; i + 64 <= n; i += 64){
+		if(!cipherBlock128(out + i, text + i, key + i, 4, 0)) return i + firstInvalid(text + i, key + i, 64);
+	}
+	for(; i + 16 <= n; i += 16){
+		if(!cipherBlock128(out + i, text + i, key + i, 1, 0)) return i + firstInvalid(text + i, key + i, 16);
+	}
+	return i + encryptScalar(out + i, text + i, key + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static size_t decryptSSE2(char* out, const char* cipher, const char* key, size_t n){
+	size_t i;
+	for(i = 0; i + 64 <= n; i += 64){
+		if(!cipherBlock128(out + i, cipher + i, key + i, 4, 1)) return i + firstInvalid(cipher + i, key + i, 64);
+	}
+	for(; i + 16 <= n; i += 16){
+		if(!cipherBlock128(out + i, cipher + i, key + i, 1, 1)) return i + firstInvalid(cipher + i, key + i, 16);
+	}
+	return i + decryptScalar(out + i, cipher + i, key + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static size_t xorSSE2(char* out, const char* data, const char* key, size_t n){
+	size_t i;
+	for(i = 0; i + 16 <= n; i += 16){
+		_mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + i)),
+			_mm_loadu_si128((const __m128i*)(key + i))));
+	}
+	return i + xorScalar(out + i, data + i, key + i, n - i);
+}
+
+/* Packing 16 values (0-31, one per byte) in two steps: neighbouring bytes into 10
+   bit pairs, then pairs of pairs into 20 bits with a multiply-add, and the two
+   halves of each 64 bit lane into one 40 bit group */
+__attribute__((target("sse2")))
+static inline __m128i groups128(__m128i v){
+	__m128i pairs = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), _mm_slli_epi16(_mm_srli_epi16(v, 8), 5));
+	__m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x04000001));		// low pair + high pair * 1024
+	return _mm_or_si128(_mm_and_si128(quads, _mm_set1_epi64x(0xFFFFFFFF)), _mm_slli_epi64(_mm_srli_epi64(quads, 32), 20));
+}
+
+// and back: a 40 bit group in each 64 bit lane to 16 values, one per byte
+__attribute__((target("sse2")))
+static inline __m128i values128(__m128i groups){
+	__m128i quads = _mm_or_si128(_mm_and_si128(groups, _mm_set1_epi64x(0xFFFFF)),
+		_mm_slli_epi64(_mm_and_si128(_mm_srli_epi64(groups, 20), _mm_set1_epi64x(0xFFFFF)), 32));
+	__m128i pairs = _mm_or_si128(_mm_and_si128(quads, _mm_set1_epi32(0x3FF)),
+		_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(quads, 10), _mm_set1_epi32(0x3FF)), 16));
+	return _mm_or_si128(_mm_and_si128(pairs, _mm_set1_epi16(0x1F)),
+		_mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(pairs, 5), _mm_set1_epi16(0x1F)), 8));
+}
+
+/* SSE2 has no byte shuffle, so each 5 byte group goes out in an 8 byte store that
+   the next one partly overwrites, and comes in with a byte shift that leaves the
+   second group in the low bits of the upper lane (values128() ignores anything
+   past 40 bits). Both run a few bytes past the 10 in use, so the loops stop while
+   at least 8 more values are left */
+__attribute__((target("sse2")))
+static void packSSE2(char* packed, const char* text, size_t n){
+	__m128i groups;
+	size_t i;
+	for(i = 0; i + 24 <= n; i += 16){
+		groups = groups128(toValue128(_mm_loadu_si128((const __m128i*)(text + i))));
+		_mm_storel_epi64((__m128i*)(packed + i / 8 * 5), groups);
+		_mm_storel_epi64((__m128i*)(packed + i / 8 * 5 + 5), _mm_unpackhi_epi64(groups, groups));
+	}
+	packScalar(packed + i / 8 * 5, text + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void unpackSSE2(char* text, const char* packed, size_t n){
+	__m128i bytes;
+	size_t i;
+	for(i = 0; i + 32 <= n; i += 16){
+		bytes = _mm_loadu_si128((const __m128i*)(packed + i / 8 * 5));
+		_mm_storeu_si128((__m128i*)(text + i), toChar128(values128(_mm_unpacklo_epi64(bytes, _mm_srli_si128(bytes, 5)))));
+	}
+	unpackScalar(text + i, packed + i / 8 * 5, n - i);
+}
+
+/* ---------------------------------------------------------------------------
+   AVX2: the same thing 32 chars at a time
+   --------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static inline __m256i toValue256(__m256i c){
+	__m256i v = _mm256_sub_epi8(c, _mm256_set1_epi8('A'));
+	__m256i letter = _mm256_adds_epu8(v, _mm256_subs_epu8(v, _mm256_set1_epi8(25)));
+	return _mm256_min_epu8(letter, _mm256_adds_epu8(_mm256_xor_si256(v, _mm256_set1_epi8((char)0xDF)), _mm256_set1_epi8(26)));
+}
+
+__attribute__((target("avx2")))
+static inline int allValid256(__m256i largest){
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(largest, _mm256_set1_epi8(26)), largest)) == -1;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold256(__m256i v){
+	return _mm256_min_epu8(v, _mm256_sub_epi8(v, _mm256_set1_epi8(27)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i toChar256(__m256i v){
+	__m256i isSpace = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(26));
+	return _mm256_blendv_epi8(_mm256_add_epi8(v, _mm256_set1_epi8('A')), _mm256_set1_epi8(' '), isSpace);
+}
+
+__attribute__((target("avx2")))
+static size_t validateAVX2(const char* text, size_t n){
+	size_t i;
+	for(i = 0; i + 32 <= n; i += 32){
+		if(!allValid256(toValue256(_mm256_loadu_si256((const __m256i*)(text + i))))) break;
+	}
+	return i + validateSSE2(text + i, n - i);
+}
+
+// as cipherBlock128(), always 4 vectors
+__attribute__((target("avx2")))
+static inline int cipherBlock256(char* out, const char* a, const char* b, int decrypt){
+	__m256i x[4], y[4], largest = _mm256_setzero_si256();
+	int j;
+	for(j = 0; j < 4; j++){
+		x[j] = toValue256(_mm256_loadu_si256((const __m256i*)(a + 32 * j)));
+		y[j] = toValue256(_mm256_loadu_si256((const __m256i*)(b + 32 * j)));
+		largest = _mm256_max_epu8(largest, _mm256_max_epu8(x[j], y[j]));
+	}
+	if(!allValid256(largest)) return 0;
+	for(j = 0; j < 4; j++){
+		if(decrypt) x[j] = _mm256_add_epi8(x[j], _mm256_sub_epi8(_mm256_set1_epi8(27), y[j]));
+		else x[j] = _mm256_add_epi8(x[j], y[j]);
+		_mm256_storeu_si256((__m256i*)(out + 32 * j), toChar256(fold256(x[j])));
+	}
+	return 1;
+}
+
+// whole blocks of 128 chars, and the SSE2 code does the rest
+__attribute__((target("avx2")))
+static size_t encryptAVX2(char* out, const char* text, const char* key, size_t n){
+	size_t i;
+	for(i = 0; i + 128 <= n; i += 128){
+		if(!cipherBlock256(out + i, text + i, key + i, 0)) return i + firstInvalid(text + i, key + i, 128);
+	}
+	return i + encryptSSE2(out + i, text + i, key + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t decryptAVX2(char* out, const char* cipher, const char* key, size_t n){
+	size_t i;
+	for(i = 0; i + 128 <= n; i += 128){
+		if(!cipherBlock256(out + i, cipher + i, key + i, 1)) return i + firstInvalid(cipher + i, key + i, 128);
+	}
+	return i + decryptSSE2(out + i, cipher + i, key + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t xorAVX2(char* out, const char* data, const char* key, size_t n){
+	size_t i;
+	for(i = 0; i + 32 <= n; i += 32){
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(data + i)),
+			_mm256_loadu_si256((const __m256i*)(key + i))));
+	}
+	return i + xorSSE2(out + i, data + i, key + i, n - i);
+}
+
+/* 32 values a step: the byte pairs are one multiply-add here, and a shuffle packs
+   each 128 bit lane's two groups into its low 10 bytes. The stores (and loads) are
+   16 bytes wide and run 6 bytes past the 20 in use, so the loops stop while at
+   least 16 more values are left and the SSE2 code finishes */
+__attribute__((target("avx2")))
+static void packAVX2(char* packed, const char* text, size_t n){
+	const __m256i squeeze = _mm256_setr_epi8(0, 1, 2, 3, 4, 8, 9, 10, 11, 12, -1, -1, -1, -1, -1, -1,
+		0, 1, 2, 3, 4, 8, 9, 10, 11, 12, -1, -1, -1, -1, -1, -1);
+	__m256i v, quads, groups;
+	size_t i;
+	for(i = 0; i + 48 <= n; i += 32){
+		v = toValue256(_mm256_loadu_si256((const __m256i*)(text + i)));
+		quads = _mm256_madd_epi16(_mm256_maddubs_epi16(v, _mm256_set1_epi16(0x2001)), _mm256_set1_epi32(0x04000001));
+		groups = _mm256_or_si256(_mm256_and_si256(quads, _mm256_set1_epi64x(0xFFFFFFFF)),
+			_mm256_slli_epi64(_mm256_srli_epi64(quads, 32), 20));
+		groups = _mm256_shuffle_epi8(groups, squeeze);
+		_mm_storeu_si128((__m128i*)(packed + i / 8 * 5), _mm256_castsi256_si128(groups));
+		_mm_storeu_si128((__m128i*)(packed + i / 8 * 5 + 10), _mm256_extracti128_si256(groups, 1));
+	}
+	packSSE2(packed + i / 8 * 5, text + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void unpackAVX2(char* text, const char* packed, size_t n){
+	const __m256i spread = _mm256_setr_epi8(0, 1, 2, 3, 4, -1, -1, -1, 5, 6, 7, 8, 9, -1, -1, -1,
+		0, 1, 2, 3, 4, -1, -1, -1, 5, 6, 7, 8, 9, -1, -1, -1);
+	const __m256i low20 = _mm256_set1_epi64x(0xFFFFF), low10 = _mm256_set1_epi32(0x3FF), low5 = _mm256_set1_epi16(0x1F);
+	__m256i groups, quads, pairs, v;
+	size_t i;
+	for(i = 0; i + 48 <= n; i += 32){
+		groups = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(packed + i / 8 * 5))),
+			_mm_loadu_si128((const __m128i*)(packed + i / 8 * 5 + 10)), 1);
+		groups = _mm256_shuffle_epi8(groups, spread);
+		quads = _mm256_or_si256(_mm256_and_si256(groups, low20), _mm256_slli_epi64(_mm256_and_si256(_mm256_srli_epi64(groups, 20), low20), 32));
+		pairs = _mm256_or_si256(_mm256_and_si256(quads, low10), _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(quads, 10), low10), 16));
+		v = _mm256_or_si256(_mm256_and_si256(pairs, low5), _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(pairs, 5), low5), 8));
+		_mm256_storeu_si256((__m256i*)(text + i), toChar256(v));
+	}
+	unpackSSE2(text + i, packed + i / 8 * 5, n - i);
+}
+#endif
+
+/* ---------------------------------------------------------------------------
+   Runtime dispatch: the first call picks a set of kernels and every later call
+   jumps straight to it
+   --------------------------------------------------------------------------- */
+
+static size_t encryptResolve(char* out, const char* text, const char* key, size_t n);
+static size_t decryptResolve(char* out, const char* cipher, const char* key, size_t n);
+static size_t xorResolve(char* out, const char* data, const char* key, size_t n);
+static size_t validateResolve(const char* text, size_t n);
+static void packResolve(char* packed, const char* text, size_t n);
+static void unpackResolve(char* text, const char* packed, size_t n);
+
+static kernelFunc encryptKernel = encryptResolve;
+static kernelFunc decryptKernel = decryptResolve;
+static kernelFunc xorKernel = xorResolve;
+static validateFunc validateKernel = validateResolve;
+static packFunc packKernel = packResolve;
+static packFunc unpackKernel = unpackResolve;
+static const char* kernelName = "scalar";
+
+static void resolveKernels(void){
+	const char* want = getenv("OTP_KERNEL");
+	kernelFunc enc = encryptScalar, dec = decryptScalar, xor = xorScalar;
+	validateFunc check = validateScalar;
+	packFunc pack = packScalar, unpack = unpackScalar;
+	const char* name = "scalar";
+
+	if(want != NULL && strcmp(want, "scalar") != 0 && strcmp(want, "sse2") != 0 && strcmp(want, "avx2") != 0){
+		fprintf(stderr, "OTP_KERNEL=%s is not scalar, sse2 or avx2, picking the kernel by CPU\n", want);
+		want = NULL;
+	}
+#ifdef OTP_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2") && (want == NULL || strcmp(want, "avx2") == 0)){
+		enc = encryptAVX2; dec = decryptAVX2; xor = xorAVX2; check = validateAVX2; name = "avx2";
+		pack = packAVX2; unpack = unpackAVX2;
+	}
+	else if(__builtin_cpu_supports("sse2") && (want == NULL || strcmp(want, "scalar") != 0)){
+		enc = encryptSSE2; dec = decryptSSE2; xor = xorSSE2; check = validateSSE2; name = "sse2";
+		pack = packSSE2; unpack = unpackSSE2;
+	}
+#endif
+	(void)want;
+	kernelName = name;											// racing threads all store the same values
+	encryptKernel = enc;
+	decryptKernel = dec;
+	xorKernel = xor;
+	validateKernel = check;
+	packKernel = pack;
+	unpackKernel = unpack;
+}
+
+static size_t encryptResolve(char* out, const char* text, const char* key, size_t n){
+	resolveKernels();
+	return encryptKernel(out, text, key, n);
+}
+
+static size_t decryptResolve(char* out, const char* cipher, const char* key, size_t n){
+	resolveKernels();
+	return decryptKernel(out, cipher, key, n);
+}
+
+static size_t xorResolve(char* out, const char* data, const char* key, size_t n){
+	resolveKernels();
+	return xorKernel(out, data, key, n);
+}
+
+static size_t validateResolve(const char* text, size_t n){
+	resolveKernels();
+	return validateKernel(text, n);
+}
+
+static void packResolve(char* packed, const char* text, size_t n){
+	resolveKernels();
+	packKernel(packed, text, n);
+}
+
+static void unpackResolve(char* text, const char* packed, size_t n){
+	resolveKernels();
+	unpackKernel(text, packed, n);
+}
+
+size_t otpEncrypt(char* out, const char* text, const char* key, size_t n){
+	return encryptKernel(out, text, key, n);
+}
+
+size_t otpDecrypt(char* out, const char* cipher, const char* key, size_t n){
+	return decryptKernel(out, cipher, key, n);
+}
+
+size_t otpXor(char* out, const char* data, const char* key, size_t n){
+	return xorKernel(out, data, key, n);
+}
+
+size_t otpValidate(const char* text, size_t n){
+	return validateKernel(text, n);
+}
+
+void otpPack(char* packed, const char* text, size_t n){
+	packKernel(packed, text, n);
+}
+
+void otpUnpack(char* text, const char* packed, size_t n){
+	unpackKernel(text, packed, n);
+}
+
+const char* otpKernelName(void){
+	if(encryptKernel == encryptResolve) resolveKernels();
+	return kernelName;
+}
@@ -0,0 +1,40 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_cipher.h
+* Description: one-time pad kernels shared by the daemons and clients: mod 27 for
+* text and XOR for byte mode. The text kernels check the alphabet as they go and
+* return n, or the offset of the first char of text or key that isn't one of
+* the 27, in which case the output is not to be used. The best
+* implementation for the running CPU (AVX2, SSE2 or plain C) is picked the first
+* time a kernel is called
+**********************************************************************************/
+#ifndef OTP_CIPHER_H
+#define OTP_CIPHER_H
+
+#include <stddef.h>
+
+#define OTP_ALPHABET "ABCDEFGHIJKLMNOPQRSTUVWXYZ "		// 27 allowed chars (0-26)
+
+// out[i] = text[i] + key[i] (mod 27) for n chars; out may alias text or key
+size_t otpEncrypt(char* out, const char* text, const char* key, size_t n);
+
+// out[i] = cipher[i] - key[i] (mod 27) for n chars; out may alias cipher or key
+size_t otpDecrypt(char* out, const char* cipher, const char* key, size_t n);
+
+// out[i] = data[i] ^ key[i] for n bytes, which both encrypts and decrypts; out may alias data or key. Always n
+size_t otpXor(char* out, const char* data, const char* key, size_t n);
+
+// offset of the first char of text outside the alphabet, or n
+size_t otpValidate(const char* text, size_t n);
+
+/* Packed wire format (see otp_proto.h): n chars of text to PACKED_SIZE(n) bytes.
+   Text must already be in the alphabet; packed may alias text */
+void otpPack(char* packed, const char* text, size_t n);
+
+// and back to n chars; values 27-31 come out as chars the kernels refuse. text must not alias packed
+void otpUnpack(char* text, const char* packed, size_t n);
+
+const char* otpKernelName(void);						// "avx2", "sse2" or "scalar"
+
+#endif
@@ -0,0 +1,1025 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_client.c
+* Description: shared client core for otp_enc and otp_dec. The text and key are
+* streamed to the daemon in fixed-size chunks while a second thread writes each
+* answered chunk to stdout, so file size is no longer limited by a buffer and
+* memory use stays the same for any input. Only the first line of each file is
+* used, as before. Several text/key pairs can be given; they all go down one
+* connection as pipelined requests and come back one line each. Batch mode
+* (-b or -d) lives in otp_batch.c and reuses the pieces exported here. Byte mode
+* (-B) sends whole files of any bytes instead of one line of letters, and memfd
+* mode (-M) hands the daemon shared memory instead of sending the bytes at all.
+* With -z letters are packed 8 to 5 bytes on the wire, if the daemon agrees to it.
+* Given a list of ports, the chunks are dealt out to all of those daemons in turn
+* and the answers read back in the same order. Connections open with a binary
+* request header that the first chunk follows straight away, with no echo to wait for.
+* Regular input files are mapped, checked in place and handed to the socket with
+* sendfile(), and results are spliced from the socket into stdout when it is a
+* file or a pipe, so plain text never passes through a buffer of ours
+**********************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include "otp_client.h"
+#include "otp_proto.h"
+#include "otp_cipher.h"
+
+#define HANDSHAKE_SIZE 64
+
+const struct otpClient* activeClient;
+int byteMode;
+int unixSocket;
+static int askPacked;													// -z
+static int fastOpen;													// -F
+
+static void error(const char *msg, int exitValue){
+	perror(msg); exit(exitValue); 					// Error function used for reporting issues
+}
+
+// read up to want bytes of the first line, stopping for good at the newline or EOF
+static int readLine(struct lineReader* r, char* buf, int want){
+	int total = 0, n;
+	char* newline;
+	while(total < want && !r->done){
+		n = read(r->fd, buf + total, want - total);
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0) return -1;
+		if(n == 0){
+			r->done = 1;
+			break;
+		}
+		newline = r->wholeFile ? NULL : memchr(buf + total, '\n', n);	// get only the chars until the newline
+		if(newline != NULL){
+			r->done = 1;
+			return newline - buf;
+		}
+		total += n;
+	}
+	return total;
+}
+
+/* The mapped counterpart of readLine(): up to want bytes of the line, left where
+   they are in the file. The file offset still marks the position, so readLine(),
+   readPadOffset() and padLength() can share the file */
+static int mapLine(struct lineReader* r, int want, long long* at){
+	off_t pos = lseek(r->fd, 0, SEEK_CUR);
+	const char* newline;
+	int n;
+
+	if(pos < 0) return -1;
+	*at = pos;
+	if(r->done) return 0;
+	n = r->size - pos < want ? r->size - pos : want;
+	newline = r->wholeFile ? NULL : memchr(r->map + pos, '\n', n);	// get only the chars until the newline
+	if(newline != NULL){
+		n = newline - (r->map + pos);
+		r->done = 1;
+	}
+	else if(pos + n >= r->size){
+		r->done = 1;
+	}
+	if(lseek(r->fd, pos + n, SEEK_SET) < 0) return -1;
+	return n;
+}
+
+// map a regular file whole; anything else, or a failed mmap(), is read as before
+static void mapFile(struct lineReader* r){
+	struct stat info;
+	void* map;
+
+	r->map = NULL;
+	if(askPacked || fstat(r->fd, &info) < 0 || !S_ISREG(info.st_mode) || info.st_size == 0) return;	// -z packs in place
+	map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+	if(map == MAP_FAILED) return;
+	madvise(map, info.st_size, MADV_SEQUENTIAL);
+	r->map = map;
+	r->size = info.st_size;
+}
+
+static void unmapFile(struct lineReader* r){
+	if(r->map != NULL) munmap((void*)r->map, r->size);
+}
+
+int recvAll(int fd, void* buf, int len){
+	int total = 0, n;
+	while(total < len){
+		n = recv(fd, (char*)buf + total, len - total, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return -1;
+		total += n;
+	}
+	return total;
+}
+
+static int sendAll(int fd, const void* buf, int len, int flags){
+	int total = 0, n;
+	while(total < len){
+		n = send(fd, (const char*)buf + total, len - total, flags);
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0) return -1;
+		total += n;
+	}
+	return total;
+}
+
+// send len bytes of fd from at, straight from the page cache
+static int sendFile(int socketFD, int fd, long long at, int len){
+	off_t offset = at;
+	ssize_t n;
+	while(len > 0){
+		n = sendfile(socketFD, fd, &offset, len);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return -1;
+		len -= n;
+	}
+	return 0;
+}
+
+int writeAll(int fd, const char* buf, int len){
+	int total = 0, n;
+	while(total < len){
+		n = write(fd, buf + total, len - total);
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0) return -1;
+		total += n;
+	}
+	return total;
+}
+
+// -u: the "port" is the path of a daemon's Unix domain socket
+static int connectUnix(const char* path){
+	struct sockaddr_un serverAddress;
+	int socketFD;
+	char msg[128];
+
+	memset(&serverAddress, '\0', sizeof(serverAddress));
+	serverAddress.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(serverAddress.sun_path)){
+		fprintf(stderr, "%s error: socket path too long\n", activeClient->name);
+		exit(2);
+	}
+	strcpy(serverAddress.sun_path, path);
+	socketFD = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socketFD < 0){
+		snprintf(msg, sizeof(msg), "%s error: opening socket", activeClient->name);
+		error(msg, 2);
+	}
+	if (connect(socketFD, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) < 0){
+		snprintf(msg, sizeof(msg), "%s error: connecting", activeClient->name);
+		error(msg, 2);
+	}
+	return socketFD;
+}
+
+// "port" is a port on localhost, or "host:port"
+int connectDaemon(const char* port){
+	struct sockaddr_in serverAddress;
+	struct hostent* serverHostInfo;
+	int socketFD, yes = 1;
+	char msg[128], host[256] = "localhost";
+	const char* colon;
+
+	if(unixSocket) return connectUnix(port);
+	colon = strrchr(port, ':');
+	if(colon != NULL){
+		snprintf(host, sizeof(host), "%.*s", (int)(colon - port), port);
+		port = colon + 1;
+	}
+
+	memset((char*)&serverAddress, '\0', sizeof(serverAddress)); 	// Clear out the address struct
+	serverAddress.sin_family = AF_INET; 							// Create a network-capable socket
+	serverAddress.sin_port = htons(atoi(port)); 					// Store the port number
+	serverHostInfo = gethostbyname(host); 							// Convert the machine name into a special form of address
+	if (serverHostInfo == NULL){
+		fprintf(stderr, "%s error: no such host\n", activeClient->name);
+		exit(2);
+	}
+	memcpy((char*)&serverAddress.sin_addr.s_addr, (char*)serverHostInfo->h_addr, serverHostInfo->h_length); // Copy in the address
+
+	socketFD = socket(AF_INET, SOCK_STREAM, 0); 					// Create the socket
+	if (socketFD < 0){
+		snprintf(msg, sizeof(msg), "%s error: opening socket", activeClient->name);
+		error(msg, 2);
+	}
+	setsockopt(socketFD, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+	setsockopt(socketFD, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));	// MSG_MORE already groups what goes together
+	if(fastOpen){															// connect() returns at once and the SYN carries the first send
+		setsockopt(socketFD, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &yes, sizeof(int));
+	}
+	if (connect(socketFD, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) < 0){ // Connect socket to address
+		snprintf(msg, sizeof(msg), "%s error: connecting", activeClient->name);
+		error(msg, 2);
+	}
+	return socketFD;
+}
+
+// send "encrypt stream" (or "encrypt pad") and expect the daemon to echo it; -1 if it answers anything else
+static int tryHandshake(int socketFD, const char* option){
+	char hello[HANDSHAKE_SIZE], buffer[HANDSHAKE_SIZE];
+	int len, got = 0, n;
+
+	len = snprintf(hello, sizeof(hello), "%s %s", activeClient->handshake, option) + 1;
+	if(sendAll(socketFD, hello, len, 0) < 0){
+		fprintf(stderr, "%s error: writing to socket: %s\n", activeClient->name, strerror(errno));
+		exit(2);
+	}
+	memset(buffer, '\0', sizeof(buffer));
+	while(got < (int)sizeof(buffer) - 1 && memchr(buffer, '\0', got) == NULL){
+		n = recv(socketFD, buffer + got, sizeof(buffer) - 1 - got, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		got += n;
+	}
+	return strcmp(buffer, hello) == 0 ? 0 : -1;
+}
+
+// as above, but anything other than the echo means it is the wrong daemon
+void handshake(int socketFD, const char* option){
+	if(tryHandshake(socketFD, option) < 0){
+		fprintf(stderr, "%s error: invalid %s connection\n", activeClient->name, activeClient->operation);
+		exit(2);
+	}
+}
+
+/* Open a stream connection with a requestHeader rather than a text handshake, so
+   the first chunk can follow right away instead of a round trip later. Nothing
+   comes back for it unless the daemon refuses, and then that is a STREAM_ERROR
+   frame where the first answer would be */
+static void sendStreamHeader(int socketFD, const char* option){
+	struct requestHeader header;
+	int flags = REQUEST_STREAM;
+
+	if(strcmp(option, PAD_OPTION) == 0) flags |= REQUEST_PAD;
+	else if(strcmp(option, BYTES_OPTION) == 0) flags |= REQUEST_BYTES;
+	header.magic = htonl(REQUEST_MAGIC);
+	header.version = REQUEST_VERSION;
+	header.operation = activeClient->requestOp;
+	header.flags = htons(flags);
+	header.length = 0;
+	if(sendAll(socketFD, &header, sizeof(header), MSG_MORE) < 0){		// goes out with the first chunk
+		fprintf(stderr, "%s error: writing to socket: %s\n", activeClient->name, strerror(errno));
+		exit(2);
+	}
+}
+
+/* Connect and open a stream. With -z, ask for the packed wire format as well; that
+   still takes a text handshake, since a daemon that doesn't know the format
+   refuses it, and then it's a new connection and the plain format. *packed says
+   which one this connection got; each daemon decides for itself */
+int openStream(const char* port, const char* option, int* packed){
+	char packedOption[HANDSHAKE_SIZE];
+	int socketFD = connectDaemon(port);
+
+	*packed = 0;
+	if(!askPacked){
+		sendStreamHeader(socketFD, option);
+		return socketFD;
+	}
+	snprintf(packedOption, sizeof(packedOption), "%s %s", option, PACKED_OPTION);
+	if(tryHandshake(socketFD, packedOption) == 0){
+		*packed = 1;
+		return socketFD;
+	}
+	close(socketFD);
+	socketFD = connectDaemon(port);
+	handshake(socketFD, option);
+	return socketFD;
+}
+
+// split a comma-separated list of ports (or socket paths); never empty, and one free() releases it
+char** splitPorts(const char* list, int* count){
+	char **ports, *copy, *port, *rest;
+	int n = 1, i;
+
+	for(i = 0; list[i] != '\0'; i++){
+		if(list[i] == ',') n++;
+	}
+	ports = malloc(sizeof(char*) * n + strlen(list) + 1);				// the entries point into the copy after them
+	if(ports == NULL) error("malloc", 1);
+	copy = (char*)(ports + n);
+	strcpy(copy, list);
+	*count = 0;
+	for(port = strtok_r(copy, ",", &rest); port != NULL; port = strtok_r(NULL, ",", &rest)){
+		ports[(*count)++] = port;
+	}
+	if(*count == 0) ports[(*count)++] = copy;							// nothing but commas: let connecting fail
+	return ports;
+}
+
+/* Receive length chars of a result. Packed answers land at the end of out (see
+   RESULT_BUFFER) and are unpacked to the front */
+int recvResult(int socketFD, int packed, char* out, int length){
+	char* wire = out + STREAM_CHUNK;
+	if(!packed) return recvAll(socketFD, out, length);
+	if(recvAll(socketFD, wire, PACKED_SIZE(length)) < 0) return -1;
+	otpUnpack(out, wire, length);
+	return length;
+}
+
+/* Results go to stdout (or a batch output file) without being copied through user
+   space where the kernel allows it: splice() moves them from the socket into a pipe
+   directly, or into a regular file by way of a pipe of our own. Terminals and files
+   opened to append are written, and so are packed answers (see copyResult()) */
+void openSink(struct resultSink* sink, int fd){
+	struct stat info;
+	int flags = fcntl(fd, F_GETFL);
+
+	sink->fd = fd;
+	sink->mode = SINK_WRITE;
+	if(flags < 0 || (flags & O_APPEND) || fstat(fd, &info) < 0) return;
+	if(S_ISFIFO(info.st_mode)){
+		sink->mode = SINK_SPLICE;
+	}
+	else if(S_ISREG(info.st_mode) && (sink->pipeFD[0] >= 0 || pipe2(sink->pipeFD, O_CLOEXEC) == 0)){
+		sink->mode = SINK_PIPE;
+	}
+}
+
+/* Empty length bytes out of the sink's pipe into its file. A file system that
+   splice() can't write to turns the sink into a plain one, starting with these */
+static int drainPipe(struct resultSink* sink, char* out, int length){
+	ssize_t n;
+	int done;
+	while(length > 0){
+		n = splice(sink->pipeFD[0], NULL, sink->fd, NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0 && errno == EINVAL) break;
+		if(n <= 0) return -1;
+		length -= n;
+	}
+	if(length == 0) return 0;
+	sink->mode = SINK_WRITE;
+	for(done = 0; done < length; done += n){
+		n = read(sink->pipeFD[0], out + done, length - done);
+		if(n < 0 && errno == EINTR) n = 0;
+		else if(n <= 0) return -1;
+	}
+	return writeAll(sink->fd, out, length) < 0 ? -1 : 0;
+}
+
+/* Copy one chunk's length result chars from the socket to the sink, using out as
+   the buffer when it has to. A packed answer is unpacked there and written, since
+   the connections sharing a sink may not all be packed. Returns -1 if the socket
+   failed and -2 if the output did */
+int copyResult(int socketFD, int packed, struct resultSink* sink, char* out, int length){
+	ssize_t n;
+
+	while(length > 0){
+		if(sink->mode == SINK_WRITE || packed){
+			if(recvResult(socketFD, packed, out, length) < 0) return -1;
+			return writeAll(sink->fd, out, length) < 0 ? -2 : 0;
+		}
+		n = splice(socketFD, NULL, sink->mode == SINK_PIPE ? sink->pipeFD[1] : sink->fd, NULL, length,
+			SPLICE_F_MOVE | SPLICE_F_MORE);
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0 && sink->mode == SINK_SPLICE && errno == EPIPE) return -2;
+		if(n <= 0) return -1;
+		if(sink->mode == SINK_PIPE && drainPipe(sink, out, n) < 0) return -2;
+		length -= n;
+	}
+	return 0;
+}
+
+void closeSink(struct resultSink* sink){
+	if(sink->pipeFD[0] >= 0){
+		close(sink->pipeFD[0]);
+		close(sink->pipeFD[1]);
+	}
+}
+
+// what the receiver needs to know about the requests going out
+struct receiveState {
+	int socketFD;
+	int packed;											// this connection got the packed wire format
+	uint32_t requests;									// answers to wait for, one per file pair
+	int padMode;
+};
+
+/* Write every answered chunk to stdout, one line per request. Answers come back
+   in the order the requests went out, so each id is checked against the next one
+   expected */
+static void* receiveThread(void* arg){
+	struct receiveState* state = arg;
+	struct streamHeader header;
+	struct padRequest range;
+	uint32_t length, flags, expected = 1;
+	int first = 1, copied;
+	char* output = malloc(RESULT_BUFFER);
+	struct resultSink sink = SINK_INIT;
+
+	if(output == NULL) error("malloc", 1);
+	openSink(&sink, STDOUT_FILENO);
+	while(expected <= state->requests){
+		if(recvAll(state->socketFD, &header, sizeof(header)) < 0){
+			fprintf(stderr, "%s error: reading %s from socket: connection closed\n", activeClient->name, activeClient->outputName);
+			exit(2);
+		}
+		length = ntohl(header.length);
+		flags = ntohl(header.flags);
+		if(flags & STREAM_ERROR){
+			if(length > STREAM_CHUNK - 1) length = STREAM_CHUNK - 1;
+			if(recvAll(state->socketFD, output, length) < 0) length = 0;
+			fprintf(stderr, "%s error: daemon reported: %.*s\n", activeClient->name, (int)length, output);
+			exit(2);
+		}
+		if(ntohl(header.id) != expected || length > STREAM_CHUNK ||
+				(state->padMode && first && recvAll(state->socketFD, &range, sizeof(range)) < 0)){
+			fprintf(stderr, "%s error: reading %s from socket: bad chunk\n", activeClient->name, activeClient->outputName);
+			exit(2);
+		}
+		if(state->padMode && first && !activeClient->padOffsetIn){			// where in the pad the key was, for otp_dec
+			printf("%llu:", (unsigned long long)be64toh(range.offset));
+			fflush(stdout);
+		}
+		first = (flags & STREAM_LAST) != 0;
+		copied = copyResult(state->socketFD, state->packed, &sink, output, length);
+		if(copied == -1){
+			fprintf(stderr, "%s error: reading %s from socket: bad chunk\n", activeClient->name, activeClient->outputName);
+			exit(2);
+		}
+		if(copied < 0) error("writing to stdout", 1);
+		if(flags & STREAM_LAST){
+			if(!byteMode) writeAll(STDOUT_FILENO, "\n", 1);			// last char printed is newline
+			expected++;
+		}
+	}
+	closeSink(&sink);
+	free(output);
+	return NULL;
+}
+
+int openPair(struct pairReader* pair, const char* textPath, const char* keyPath){
+	pair->textPath = textPath;
+	pair->keyPath = keyPath;
+	pair->text.done = pair->key.done = 0;
+	pair->offset = 0;
+	pair->text.wholeFile = pair->key.wholeFile = byteMode;
+	pair->key.fd = -1;
+	pair->key.map = NULL;
+	pair->inPlace = 0;
+	pair->text.fd = open(textPath, O_RDONLY);
+	if(pair->text.fd < 0){												// check that file can be opened
+		fprintf(stderr, "%s error: opening %s file '%s': %s\n", activeClient->name, activeClient->inputName, textPath, strerror(errno));
+		return -1;
+	}
+	mapFile(&pair->text);
+	if(keyPath == NULL) return 0;										// pad mode
+	pair->key.fd = open(keyPath, O_RDONLY);
+	if(pair->key.fd < 0){
+		fprintf(stderr, "%s error: opening key file '%s': %s\n", activeClient->name, keyPath, strerror(errno));
+		unmapFile(&pair->text);
+		close(pair->text.fd);
+		return -1;
+	}
+	mapFile(&pair->key);
+	return 0;
+}
+
+/* Read up to want bytes of text and the key to go with it, and check both. With
+   inPlace set and both files mapped nothing is copied: the chunk is checked where
+   it is and sendChunk() sends it from the files */
+static int readChunk(struct pairReader* pair, char* textBuf, char* keyBuf, int want, int inPlace){
+	const char *text = textBuf, *key = keyBuf;
+	int textLen, keyLen;
+	size_t bad;
+
+	pair->inPlace = inPlace && pair->text.map != NULL && (pair->key.fd < 0 || pair->key.map != NULL);
+	if(pair->inPlace){
+		textLen = mapLine(&pair->text, want, &pair->textAt);
+		text = pair->text.map + pair->textAt;
+	}
+	else{
+		textLen = readLine(&pair->text, textBuf, want);
+	}
+	if(textLen < 0){
+		fprintf(stderr, "%s error: reading %s file '%s': %s\n", activeClient->name, activeClient->inputName, pair->textPath, strerror(errno));
+		return -1;
+	}
+	if(pair->key.fd < 0){
+		keyLen = textLen;
+	}
+	else if(pair->inPlace){
+		keyLen = mapLine(&pair->key, textLen, &pair->keyAt);
+		key = pair->key.map + pair->keyAt;
+	}
+	else{
+		keyLen = readLine(&pair->key, keyBuf, textLen);
+	}
+	if(keyLen < textLen){												// key must be large enough to account for the text
+		fprintf(stderr, "%s error: key '%s' is too short\n", activeClient->name, pair->keyPath);
+		return -1;
+	}
+	if(!byteMode && (bad = otpValidate(text, textLen)) < (size_t)textLen){	// only capital letters and spaces are allowed
+		fprintf(stderr, "%s error: '%s' contains invalid characters (offset %lld)\n", activeClient->name, pair->textPath,
+			pair->offset + (long long)bad);
+		return -1;
+	}
+	if(!byteMode && pair->key.fd >= 0 && (bad = otpValidate(key, textLen)) < (size_t)textLen){
+		fprintf(stderr, "%s error: key '%s' contains invalid characters (offset %lld)\n", activeClient->name, pair->keyPath,
+			pair->offset + (long long)bad);
+		return -1;
+	}
+	pair->offset += textLen;
+	return textLen;
+}
+
+int nextChunk(struct pairReader* pair, char* textBuf, char* keyBuf){
+	return readChunk(pair, textBuf, keyBuf, STREAM_CHUNK, 1);
+}
+
+void closePair(struct pairReader* pair){
+	unmapFile(&pair->text);
+	unmapFile(&pair->key);
+	close(pair->text.fd);
+	if(pair->key.fd >= 0) close(pair->key.fd);
+}
+
+/* One chunk of request id, as nextChunk() left it: header, the pad range if any,
+   text, then the matching key bytes. A chunk still in its files goes out with
+   sendfile(); with the packed wire format text and key are packed in place first */
+int sendChunk(int socketFD, int packed, uint32_t id, struct pairReader* pair, char* textBuf, char* keyBuf, int length,
+		int last, const struct padRequest* range){
+	struct streamHeader header;
+	int wireLength = length;
+
+	if(pair->inPlace){
+		header.id = htonl(id);
+		header.length = htonl(length);
+		header.flags = htonl(last ? STREAM_LAST : 0);
+		if(sendAll(socketFD, &header, sizeof(header), MSG_MORE) < 0 ||
+				(range != NULL && sendAll(socketFD, range, sizeof(*range), MSG_MORE) < 0) ||
+				sendFile(socketFD, pair->text.fd, pair->textAt, length) < 0 ||
+				(pair->key.fd >= 0 && sendFile(socketFD, pair->key.fd, pair->keyAt, length) < 0)){
+			return -1;
+		}
+		return 0;
+	}
+	if(packed){
+		otpPack(textBuf, textBuf, length);
+		if(keyBuf != NULL) otpPack(keyBuf, keyBuf, length);
+		wireLength = PACKED_SIZE(length);
+	}
+	header.id = htonl(id);
+	header.length = htonl(length);
+	header.flags = htonl(last ? STREAM_LAST : 0);
+	if(sendAll(socketFD, &header, sizeof(header), MSG_MORE) < 0 ||
+			(range != NULL && sendAll(socketFD, range, sizeof(*range), MSG_MORE) < 0) ||
+			sendAll(socketFD, textBuf, wireLength, keyBuf != NULL ? MSG_MORE : 0) < 0 ||
+			(keyBuf != NULL && sendAll(socketFD, keyBuf, wireLength, 0) < 0)){
+		return -1;
+	}
+	return 0;
+}
+
+// pad mode: otp_dec's input starts with the "offset:" that otp_enc printed
+static int readPadOffset(struct pairReader* pair, uint64_t* offset){
+	char c = '\0';
+	int n, digits = 0;
+
+	*offset = 0;
+	while((n = read(pair->text.fd, &c, 1)) == 1 && c >= '0' && c <= '9' && digits < 20){
+		*offset = *offset * 10 + (c - '0');
+		digits++;
+	}
+	if(n != 1 || c != ':' || digits == 0){
+		fprintf(stderr, "%s error: '%s' does not start with a pad offset\n", activeClient->name, pair->textPath);
+		return -1;
+	}
+	return 0;
+}
+
+// pad mode: the daemon needs the request's length up front, so measure the rest of the line
+static int64_t padLength(struct pairReader* pair, char* scratch){
+	off_t start = lseek(pair->text.fd, 0, SEEK_CUR), at = start;
+	char* newline;
+	int n = -1;
+
+	while(start >= 0 && (n = pread(pair->text.fd, scratch, STREAM_CHUNK, at)) > 0){
+		newline = memchr(scratch, '\n', n);
+		if(newline != NULL) return at + (newline - scratch) - start;
+		at += n;
+	}
+	if(n < 0){
+		fprintf(stderr, "%s error: pad mode needs a regular file, not '%s'\n", activeClient->name, pair->textPath);
+		return -1;
+	}
+	return at - start;
+}
+
+/* Stream one text/key pair as request id, checking each chunk before it goes out.
+   The connection is only set up once the first chunk of the first pair has passed,
+   so small files fail without any output */
+static void sendPair(struct receiveState* state, pthread_t* receiver, uint32_t id,
+		const char* textPath, const char* keyPath, const char* port, char* textBuf, char* keyBuf){
+	struct pairReader pair;
+	struct padRequest range, *first = NULL;
+	uint64_t offset = PAD_NEXT;
+	int64_t total;
+	int length;
+
+	if(openPair(&pair, textPath, keyPath) < 0) exit(1);
+	if(state->padMode){													// no key file: name a range of the daemon's pad
+		if(activeClient->padOffsetIn && readPadOffset(&pair, &offset) < 0) exit(1);
+		if((total = padLength(&pair, textBuf)) < 0) exit(1);
+		range.offset = htobe64(offset);
+		range.length = htobe64(total);
+		first = &range;
+		keyBuf = NULL;
+	}
+	do{
+		length = nextChunk(&pair, textBuf, keyBuf);
+		if(length < 0) exit(1);
+
+		if(state->socketFD < 0){										// first chunk is good: set up the server
+			state->socketFD = openStream(port, state->padMode ? PAD_OPTION : byteMode ? BYTES_OPTION : STREAM_OPTION, &state->packed);
+			if(pthread_create(receiver, NULL, receiveThread, state) != 0){
+				error("pthread_create", 2);
+			}
+		}
+		if(sendChunk(state->socketFD, state->packed, id, &pair, textBuf, keyBuf, length, pair.text.done, first) < 0){
+			fprintf(stderr, "%s error: writing to socket: %s\n", activeClient->name, strerror(errno));
+			exit(2);
+		}
+		first = NULL;
+	}while(!pair.text.done);
+	closePair(&pair);
+}
+
+/* Several daemons for one run: every chunk is a request of its own, dealt to the
+   daemons in turn and tagged with its pair's number. Each daemon answers in order,
+   so reading one answer from each in the same turn puts the output back in order,
+   and a change of tag is the end of a pair's line */
+struct stripeState {
+	int* socketFD;
+	int* packed;										// per daemon: they need not all know the packed format
+	int count;
+	long long sent;										// chunks sent so far
+	int sendDone;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+static void* stripeReceiver(void* arg){
+	struct stripeState* state = arg;
+	struct streamHeader header;
+	uint32_t length, flags, current = 0;
+	long long chunk;
+	int socketFD, copied;
+	char* output = malloc(RESULT_BUFFER);
+	struct resultSink sink = SINK_INIT;
+
+	if(output == NULL) error("malloc", 1);
+	openSink(&sink, STDOUT_FILENO);
+	for(chunk = 0; ; chunk++){
+		pthread_mutex_lock(&state->lock);
+		while(chunk == state->sent && !state->sendDone){
+			pthread_cond_wait(&state->changed, &state->lock);
+		}
+		if(chunk == state->sent){
+			pthread_mutex_unlock(&state->lock);
+			break;
+		}
+		pthread_mutex_unlock(&state->lock);
+
+		socketFD = state->socketFD[chunk % state->count];
+		if(recvAll(socketFD, &header, sizeof(header)) < 0){
+			fprintf(stderr, "%s error: reading %s from socket: connection closed\n", activeClient->name, activeClient->outputName);
+			exit(2);
+		}
+		length = ntohl(header.length);
+		flags = ntohl(header.flags);
+		if(flags & STREAM_ERROR){
+			if(length > STREAM_CHUNK - 1) length = STREAM_CHUNK - 1;
+			if(recvAll(socketFD, output, length) < 0) length = 0;
+			fprintf(stderr, "%s error: daemon reported: %.*s\n", activeClient->name, (int)length, output);
+			exit(2);
+		}
+		if(length > STREAM_CHUNK){
+			fprintf(stderr, "%s error: reading %s from socket: bad chunk\n", activeClient->name, activeClient->outputName);
+			exit(2);
+		}
+		if(ntohl(header.id) != current){
+			if(current != 0 && !byteMode) writeAll(STDOUT_FILENO, "\n", 1);	// a new pair starts a new line
+			current = ntohl(header.id);
+		}
+		copied = copyResult(socketFD, state->packed[chunk % state->count], &sink, output, length);
+		if(copied == -1){
+			fprintf(stderr, "%s error: reading %s from socket: bad chunk\n", activeClient->name, activeClient->outputName);
+			exit(2);
+		}
+		if(copied < 0) error("writing to stdout", 1);
+	}
+	if(current != 0 && !byteMode) writeAll(STDOUT_FILENO, "\n", 1);
+	closeSink(&sink);
+	free(output);
+	return NULL;
+}
+
+static void runStriped(int argc, char* argv[], char* textBuf, char* keyBuf){
+	struct stripeState state;
+	struct pairReader pair;
+	pthread_t receiver;
+	char** ports = splitPorts(argv[argc - 1], &state.count);
+	int i, d, length;
+
+	state.socketFD = NULL;
+	state.sent = 0;
+	state.sendDone = 0;
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_cond_init(&state.changed, NULL);
+	for(i = 1; i < argc - 1; i += 2){
+		if(openPair(&pair, argv[i], argv[i + 1]) < 0) exit(1);
+		do{
+			length = nextChunk(&pair, textBuf, keyBuf);
+			if(length < 0) exit(1);
+			if(state.socketFD == NULL){									// first chunk is good: set up every daemon
+				state.socketFD = malloc(sizeof(int) * state.count);
+				state.packed = malloc(sizeof(int) * state.count);
+				if(state.socketFD == NULL || state.packed == NULL) error("malloc", 1);
+				for(d = 0; d < state.count; d++){
+					state.socketFD[d] = openStream(ports[d], byteMode ? BYTES_OPTION : STREAM_OPTION, &state.packed[d]);
+				}
+				if(pthread_create(&receiver, NULL, stripeReceiver, &state) != 0){
+					error("pthread_create", 2);
+				}
+			}
+			d = state.sent % state.count;
+			if(sendChunk(state.socketFD[d], state.packed[d], (i + 1) / 2, &pair, textBuf, keyBuf, length, 1, NULL) < 0){
+				fprintf(stderr, "%s error: writing to socket: %s\n", activeClient->name, strerror(errno));
+				exit(2);
+			}
+			pthread_mutex_lock(&state.lock);
+			state.sent++;
+			pthread_cond_signal(&state.changed);
+			pthread_mutex_unlock(&state.lock);
+		}while(!pair.text.done);
+		closePair(&pair);
+	}
+
+	pthread_mutex_lock(&state.lock);
+	state.sendDone = 1;
+	pthread_cond_signal(&state.changed);
+	pthread_mutex_unlock(&state.lock);
+	for(d = 0; d < state.count; d++){
+		shutdown(state.socketFD[d], SHUT_WR);								// no more requests
+	}
+	pthread_join(receiver, NULL);
+	for(d = 0; d < state.count; d++){
+		close(state.socketFD[d]);
+	}
+	free(state.socketFD);
+	free(state.packed);
+	free(ports);
+}
+
+// send a memfd mode request header with the memfd attached
+static int sendDescriptor(int socketFD, const struct streamHeader* header, int fd){
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr* cmsg;
+	int n;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	iov.iov_base = (void*)header;
+	iov.iov_len = sizeof(*header);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	while((n = sendmsg(socketFD, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+	return n == (int)sizeof(*header) ? 0 : -1;
+}
+
+/* -M: text and key go through a ring of slots in one sealed memfd instead of down
+   the socket. The memfd is passed once, with the first chunk header; after that
+   each chunk is read straight into its slot and announced by a header alone, and
+   its answer is written out from the same slot. Up to MEMFD_SLOTS chunks are in
+   flight, so reading the files overlaps with the daemon's ciphering */
+struct memfdRing {
+	int socketFD, memFD;
+	char* shared;
+	unsigned sent, answered;							// chunks so far, which pick the slots
+	int length[MEMFD_SLOTS];
+};
+
+static void openRing(struct memfdRing* ring){
+	ring->socketFD = -1;
+	ring->sent = ring->answered = 0;
+	ring->memFD = memfd_create("otp", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(ring->memFD < 0 || ftruncate(ring->memFD, MEMFD_SIZE) < 0 ||
+			fcntl(ring->memFD, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0){
+		error("memfd_create", 1);
+	}
+	ring->shared = mmap(NULL, MEMFD_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, ring->memFD, 0);
+	if(ring->shared == MAP_FAILED) error("mmap", 1);
+}
+
+static char* ringSlot(struct memfdRing* ring, unsigned chunk){
+	return ring->shared + (size_t)(chunk % MEMFD_SLOTS) * 2 * MEMFD_SLOT;
+}
+
+// wait for the oldest chunk's answer and write its result out of the slot
+static void memfdAnswer(struct memfdRing* ring){
+	struct streamHeader header;
+	uint32_t length, flags;
+	char msg[128];
+
+	if(recvAll(ring->socketFD, &header, sizeof(header)) < 0){
+		fprintf(stderr, "%s error: reading %s from socket: connection closed\n", activeClient->name, activeClient->outputName);
+		exit(2);
+	}
+	length = ntohl(header.length);
+	flags = ntohl(header.flags);
+	if(flags & STREAM_ERROR){
+		if(length > sizeof(msg) - 1) length = sizeof(msg) - 1;
+		if(recvAll(ring->socketFD, msg, length) < 0) length = 0;
+		fprintf(stderr, "%s error: daemon reported: %.*s\n", activeClient->name, (int)length, msg);
+		exit(2);
+	}
+	if(length != (uint32_t)ring->length[ring->answered % MEMFD_SLOTS]){
+		fprintf(stderr, "%s error: reading %s from socket: bad chunk\n", activeClient->name, activeClient->outputName);
+		exit(2);
+	}
+	if(writeAll(STDOUT_FILENO, ringSlot(ring, ring->answered), length) < 0){
+		error("writing to stdout", 1);
+	}
+	if((flags & STREAM_LAST) && !byteMode) writeAll(STDOUT_FILENO, "\n", 1);	// last char printed is newline
+	ring->answered++;
+}
+
+// one text/key pair as request id, a slot at a time
+static void memfdPair(struct memfdRing* ring, uint32_t id, const char* textPath, const char* keyPath, const char* port){
+	struct pairReader pair;
+	struct streamHeader header;
+	char* slot;
+	int length, sent;
+
+	if(openPair(&pair, textPath, keyPath) < 0) exit(1);
+	do{
+		if(ring->sent - ring->answered == MEMFD_SLOTS) memfdAnswer(ring);	// wait for the slot to come free
+		slot = ringSlot(ring, ring->sent);
+		length = readChunk(&pair, slot, slot + MEMFD_SLOT, MEMFD_SLOT, 0);
+		if(length < 0) exit(1);
+
+		if(ring->socketFD < 0){											// first chunk is good: set up the server
+			ring->socketFD = connectDaemon(port);
+			handshake(ring->socketFD, byteMode ? MEMFD_OPTION " " BYTES_OPTION : MEMFD_OPTION);
+		}
+		header.id = htonl(id);
+		header.length = htonl(length);
+		header.flags = htonl(pair.text.done ? STREAM_LAST : 0);
+		sent = ring->sent == 0 ? sendDescriptor(ring->socketFD, &header, ring->memFD) :
+			sendAll(ring->socketFD, &header, sizeof(header), 0);
+		if(sent < 0){
+			fprintf(stderr, "%s error: writing to socket: %s\n", activeClient->name, strerror(errno));
+			exit(2);
+		}
+		ring->length[ring->sent++ % MEMFD_SLOTS] = length;
+	}while(!pair.text.done);
+	closePair(&pair);
+}
+
+// -S: ask the daemon for its load report and print it
+static int printStats(const char* port){
+	char buffer[4096];
+	int socketFD = connectDaemon(port), n;
+
+	if(sendAll(socketFD, "stats", 6, 0) < 0){
+		fprintf(stderr, "%s error: writing to socket: %s\n", activeClient->name, strerror(errno));
+		exit(2);
+	}
+	while((n = recv(socketFD, buffer, sizeof(buffer), 0)) != 0){
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0){
+			fprintf(stderr, "%s error: reading stats from socket: %s\n", activeClient->name, strerror(errno));
+			exit(2);
+		}
+		writeAll(STDOUT_FILENO, buffer, n);
+	}
+	close(socketFD);
+	return 0;
+}
+
+static void usage(const char* prog){
+	fprintf(stderr,"USAGE: %s [-B | -z] %sfile keyfile [%sfile keyfile ...] port\n", prog, activeClient->inputName, activeClient->inputName);
+	fprintf(stderr,"       %s [-B | -z] [-j connections] -b manifest | -d directory port\n", prog);
+	fprintf(stderr,"       %s -P [-z] %sfile [%sfile ...] port\n", prog, activeClient->inputName, activeClient->inputName);
+	fprintf(stderr,"       %s -M [-B] %sfile keyfile [%sfile keyfile ...] socketpath\n", prog, activeClient->inputName, activeClient->inputName);
+	fprintf(stderr,"       %s -S port\n", prog);
+	fprintf(stderr,"  -u: port is the path of the daemon's Unix domain socket (implied by -M)\n");
+	fprintf(stderr,"  -z: pack letters 8 to 5 bytes on the wire, for slow links\n");
+	fprintf(stderr,"  -F: connect with TCP Fast Open, if the daemon was started with -F\n");
+	fprintf(stderr,"  port may be host:port, or a comma-separated list of daemons to share the work (not with -P or -M)\n");
+	exit(0);
+}
+
+int runClient(const struct otpClient* client, int argc, char* argv[]){
+	struct receiveState state;
+	struct memfdRing ring;
+	char *textBuf, *keyBuf;
+	const char *manifest = NULL, *directory = NULL, *prog = argv[0];
+	pthread_t receiver;
+	int i, opt, padMode = 0, memfdMode = 0, stats = 0, striped, connections = BATCH_CONNECTIONS;
+
+	activeClient = client;
+	while((opt = getopt(argc, argv, "b:d:j:PBMSuzF")) != -1){
+		switch(opt){
+			case 'b': manifest = optarg; break;
+			case 'd': directory = optarg; break;
+			case 'j': connections = atoi(optarg); break;
+			case 'P': padMode = 1; break;
+			case 'B': byteMode = 1; break;
+			case 'M': memfdMode = unixSocket = 1; break;
+			case 'S': stats = 1; break;
+			case 'u': unixSocket = 1; break;
+			case 'z': askPacked = 1; break;
+			case 'F': fastOpen = 1; break;
+			default: usage(prog);
+		}
+	}
+	if(stats){															// load report, see otp_stats.h
+		if(optind != argc - 1) usage(prog);
+		return printStats(argv[optind]);
+	}
+	if(askPacked && (byteMode || memfdMode)) usage(prog);				// only letters pack, and only on the wire
+	if(manifest != NULL || directory != NULL){							// many files, each to its own output
+		if((manifest != NULL && directory != NULL) || optind != argc - 1 || connections < 1 || padMode || memfdMode){
+			usage(prog);
+		}
+		return runBatch(manifest, directory, connections, argv[optind]);
+	}
+	if(padMode && (byteMode || memfdMode)) usage(prog);					// the pad holds letters
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (padMode ? argc < 3 : argc < 4 || argc % 2 != 0){				// check args
+		usage(prog);
+	}
+	striped = strchr(argv[argc - 1], ',') != NULL;
+	if(striped && (padMode || memfdMode)) usage(prog);					// pad ranges and slots belong to one daemon
+	if(memfdMode){														// through shared memory instead
+		openRing(&ring);
+		for(i = 1; i < argc - 1; i += 2){
+			memfdPair(&ring, (i + 1) / 2, argv[i], argv[i + 1], argv[argc - 1]);
+		}
+		while(ring.answered < ring.sent) memfdAnswer(&ring);
+		close(ring.socketFD);
+		return 0;
+	}
+	textBuf = malloc(STREAM_CHUNK);
+	keyBuf = malloc(STREAM_CHUNK);
+	if(textBuf == NULL || keyBuf == NULL) error("malloc", 1);
+	if(striped){														// spread over several daemons
+		runStriped(argc, argv, textBuf, keyBuf);
+		free(textBuf);
+		free(keyBuf);
+		return 0;
+	}
+
+	// every pair is its own request on the one connection, sent without waiting
+	state.socketFD = -1;
+	state.padMode = padMode;
+	if(padMode){														// pad mode: text files only
+		state.requests = argc - 2;
+		for(i = 1; i < argc - 1; i++){
+			sendPair(&state, &receiver, i, argv[i], NULL, argv[argc - 1], textBuf, keyBuf);
+		}
+	}
+	else{
+		state.requests = (argc - 2) / 2;
+		for(i = 1; i < argc - 1; i += 2){
+			sendPair(&state, &receiver, (i + 1) / 2, argv[i], argv[i + 1], argv[argc - 1], textBuf, keyBuf);
+		}
+	}
+	shutdown(state.socketFD, SHUT_WR);									// no more requests
+	pthread_join(receiver, NULL);
+
+	close(state.socketFD); 												// Close the socket
+	free(textBuf);
+	free(keyBuf);
+	return 0;
+}
@@ -0,0 +1,83 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_client.h
+* Description: shared client core used by otp_enc and otp_dec. Each client
+* describes itself with an otpClient and hands control to runClient()
+**********************************************************************************/
+#ifndef OTP_CLIENT_H
+#define OTP_CLIENT_H
+
+struct otpClient {
+	const char* name;						// program name used in error messages
+	const char* handshake;					// "encrypt" or "decrypt"
+	const char* operation;					// "encryption" or "decryption", for error messages
+	const char* inputName;					// what the first file holds: "plaintext" or "cipher"
+	const char* outputName;					// what comes back: "cipher" or "plaintext"
+	int padOffsetIn;						// with -P the input starts with "offset:" (otp_dec) instead of the output
+	int requestOp;							// REQUEST_ENCRYPT or REQUEST_DECRYPT, for header mode
+};
+
+int runClient(const struct otpClient* client, int argc, char* argv[]);
+
+/* Internals shared by otp_client.c and otp_batch.c */
+
+#include <stdint.h>
+#include "otp_proto.h"
+
+#define BATCH_CONNECTIONS 4							// default connection pool size for -b and -d
+#define BATCH_WINDOW 64								// requests one batch connection keeps in flight
+#define RESULT_BUFFER (STREAM_CHUNK + PACKED_SIZE(STREAM_CHUNK))	// a chunk's result, with room behind it to arrive packed
+
+// reads the first line of a file a piece at a time
+struct lineReader {
+	int fd;
+	int done;								// newline or end of file seen
+	int wholeFile;							// byte mode: newlines are data too
+	const char* map;						// a regular file mapped whole, or NULL
+	long long size;							// of the mapping
+};
+
+// the text and key files of one request; no key file in pad mode
+struct pairReader {
+	struct lineReader text, key;
+	const char *textPath, *keyPath;
+	long long offset;						// text bytes read so far, for error messages
+	int inPlace;							// the last chunk was left in the files, at textAt and keyAt
+	long long textAt, keyAt;
+};
+
+// where a receiver's results go: see copyResult()
+struct resultSink {
+	int fd;
+	int mode;
+	int pipeFD[2];							// SINK_PIPE: socket to pipe to file, kept from one file to the next
+};
+#define SINK_WRITE 0						// received into a buffer and written out
+#define SINK_SPLICE 1						// spliced into fd, a pipe
+#define SINK_PIPE 2							// spliced into pipeFD and on into fd, a file
+#define SINK_INIT { -1, SINK_WRITE, { -1, -1 } }
+
+extern const struct otpClient* activeClient;
+extern int byteMode;										// -B: whole files of any bytes, XORed
+extern int unixSocket;										// -u: connect to a socket path instead of a port
+
+int openPair(struct pairReader* pair, const char* textPath, const char* keyPath);	// -1 after reporting why
+int nextChunk(struct pairReader* pair, char* textBuf, char* keyBuf);				// chunk length, -1 after reporting why
+																			// (the buffers are left alone for mapped files)
+void closePair(struct pairReader* pair);
+int connectDaemon(const char* port);										// exits if the daemon can't be reached
+char** splitPorts(const char* list, int* count);							// "port,port,...", see runStriped()
+void handshake(int socketFD, const char* option);							// exits if it is the wrong daemon
+int openStream(const char* port, const char* option, int* packed);			// connectDaemon() and handshake(), packed if it can
+int sendChunk(int socketFD, int packed, uint32_t id, struct pairReader* pair, char* textBuf, char* keyBuf, int length,
+		int last, const struct padRequest* range);								// keyBuf NULL and range set in pad mode
+int recvAll(int fd, void* buf, int len);
+int recvResult(int socketFD, int packed, char* out, int length);			// out holds RESULT_BUFFER bytes
+void openSink(struct resultSink* sink, int fd);								// point a SINK_INIT sink at fd
+int copyResult(int socketFD, int packed, struct resultSink* sink, char* out, int length);	// -1 with errno set
+void closeSink(struct resultSink* sink);
+int writeAll(int fd, const char* buf, int len);
+int runBatch(const char* manifest, const char* directory, int connections, const char* port);	// otp_batch.c
+
+#endif
@@ -0,0 +1,38 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_d.c
+* Description: daemon that serves otp_enc and otp_dec both, on one port. Each
+* connection names its operation in its handshake, so encryption and decryption
+* share one worker pool, one pad store and one set of statistics
+**********************************************************************************/
+#include "otp_daemon.h"
+#include "otp_cipher.h"
+#include "otp_proto.h"
+
+int main(int argc, char *argv[]){
+	static const struct otpService encrypt = {
+		.name = "otp_d",
+		.handshake = "encrypt",
+		.operation = "encryption",
+		.transform = otpEncrypt,
+		.consumesPad = 1,
+		.requestOp = REQUEST_ENCRYPT
+	};
+	static const struct otpService decrypt = {
+		.name = "otp_d",
+		.handshake = "decrypt",
+		.operation = "decryption",
+		.transform = otpDecrypt,
+		.consumesPad = 0,
+		.requestOp = REQUEST_DECRYPT
+	};
+	static const struct otpService* const operations[] = { &encrypt, &decrypt, NULL };
+	static const struct otpService service = {
+		.name = "otp_d",
+		.operation = "encryption and decryption",
+		.consumesPad = 1,
+		.operations = operations
+	};
+	return runDaemon(&service, argc, argv);				// accept loop and worker pool live in otp_daemon.c
+}
@@ -0,0 +1,570 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_daemon.c
+* Description: shared server core for otp_enc_d and otp_dec_d. By default the main
+* thread accepts connections and hands them to a fixed pool of worker threads
+* through a bounded queue, so requests are served concurrently without a fork per
+* request. With -e the connections are multiplexed by epoll loops instead, and
+* with -i by io_uring loops. With -a each acceptor gets its own SO_REUSEPORT
+* socket on the port, so the kernel spreads a burst of connects across them.
+* Workers are split into a fast lane for small requests and a bulk lane, so a
+* 20 character message never waits behind a multi-MB file. SIGUSR2 hot restarts
+* the daemon (see otp_restart.h) and SIGQUIT drains it: no more accepting, the
+* connections already in hand are finished, then it exits
+**********************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "otp_daemon.h"
+#include "otp_session.h"
+#include "otp_pad.h"
+#include "otp_stats.h"
+#include "otp_stripe.h"
+#include "otp_restart.h"
+
+#define DEFAULT_INFLIGHT 256
+#define DEFAULT_IDLE_SECONDS 60
+#define DEFAULT_SMALL_LIMIT (16 * 1024)
+#define DEFAULT_BACKLOG SOMAXCONN								// the kernel caps it at net.core.somaxconn anyway
+
+// an accepted connection and when it came in, for the handshake latency
+struct queuedConn {
+	int fd;
+	double acceptedAt;
+	struct otpSession* session;									// NULL until a worker starts serving it
+};
+
+/* bounded queues of connections waiting for a worker: new ones, and ones the fast
+   lane found too big and handed to the bulk lane part way through */
+struct connQueue {
+	struct queuedConn* conns;
+	int head, count;
+	struct queuedConn* bulk;
+	int bulkHead, bulkCount;
+	int inFlight, limit;										// accepted but not yet closed, and the cap on that
+	int acceptors;												// acceptor threads still running
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty, notFull, bulkReady, drained;
+};
+
+static struct daemonConfig config;
+static struct padStore pad;
+static int listenBacklog = DEFAULT_BACKLOG;
+static int fastOpen;														// -F
+static struct connQueue queue = { NULL, 0, 0, NULL, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+static int draining;														// set once by SIGQUIT, never cleared
+static pthread_t* acceptorIDs;												// worker pool acceptors, to interrupt accept()
+static int predecessor = -1;												// hot restart: pidfd of the daemon we replace
+static int ready = -1;														// and the pipe that tells it we're up
+static char** daemonArgv;													// what a hot restart runs again
+static int loopsFinished;
+static pthread_mutex_t loopLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void error(const char *msg, int exitValue) { perror(msg); exit(exitValue); } // Error function used for reporting issues
+
+// hand a descriptor passed with SCM_RIGHTS over to the session that received it
+void takeDescriptor(struct otpSession* session, struct msghdr* msg){
+	struct cmsghdr* cmsg;
+	int fd;
+	for(cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)){
+		if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int))){
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+			sessionTakeDescriptor(session, fd);
+		}
+	}
+}
+
+/* recv() for a session. A memfd mode session waiting for a request header reads it
+   with recvmsg() instead, to pick up the descriptor that rides along with it */
+int recvSession(struct otpSession* session, int socketFD, char* buf, int len){
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	struct iovec iov;
+	int n;
+
+	if(!sessionWantsDescriptor(session)) return recv(socketFD, buf, len, 0);
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	n = recvmsg(socketFD, &msg, MSG_CMSG_CLOEXEC);
+	if(n >= 0) takeDescriptor(session, &msg);
+	return n;
+}
+
+// fast lane: pass a connection whose request turned out big on to the bulk workers
+static void handToBulkLane(struct queuedConn* conn){
+	pthread_mutex_lock(&queue.lock);
+	queue.bulk[(queue.bulkHead + queue.bulkCount) % queue.limit] = *conn;	// never more than inFlight of them
+	queue.bulkCount++;
+	pthread_cond_signal(&queue.bulkReady);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+/* Drive one connection's session with blocking calls. The session takes no input
+   while it has output waiting, so sending and receiving simply alternate. A fast
+   lane worker stops as soon as a request is announced past the small limit and
+   hands the connection over instead; returns 1 then, 0 once it is done */
+static int serveConnection(struct queuedConn* conn, int fastLane){
+	struct otpSession* session = conn->session;
+	struct iovec out[2];
+	char* in;
+	int n;
+
+	while(!sessionFinished(session)){
+		if(fastLane && sessionRequestSize(session) > config.smallLimit){
+			handToBulkLane(conn);
+			return 1;
+		}
+		if((n = sessionSendData(session, out)) > 0){
+			n = writev(conn->fd, out, n);									// an answer's header and its data in one go
+			if(n < 0){
+				if(errno == EINTR) continue;
+				fprintf(stderr, "%s error: writing to socket: %s\n", config.service->name, strerror(errno));
+				break;
+			}
+			if(sessionSent(session, n) < 0) break;
+		}
+		else if((n = sessionRecvSpace(session, &in)) > 0){
+			n = recvSession(session, conn->fd, in, n);
+			if(n < 0 && errno == EINTR) continue;
+			if(n < 0){
+				fprintf(stderr, "%s error: reading from socket: %s\n", config.service->name,
+					errno == EAGAIN ? "client idle too long" : strerror(errno));
+				break;
+			}
+			if(sessionReceived(session, n) < 0) break;
+		}
+		else{
+			break;
+		}
+	}
+	return 0;
+}
+
+// block the acceptor while the in-flight limit is reached, then queue the connection
+static void enqueueConnection(int fd){
+	struct queuedConn conn = { fd, statNow(), NULL };
+	pthread_mutex_lock(&queue.lock);
+	while(queue.inFlight >= queue.limit){
+		pthread_cond_wait(&queue.notFull, &queue.lock);
+	}
+	queue.conns[(queue.head + queue.count) % queue.limit] = conn;
+	queue.count++;
+	queue.inFlight++;
+	pthread_cond_signal(&queue.notEmpty);
+	pthread_cond_signal(&queue.bulkReady);									// an idle bulk worker takes small ones too
+	pthread_mutex_unlock(&queue.lock);
+}
+
+// bulk workers take handed over connections first, and new ones when there are none
+static struct queuedConn dequeueConnection(int fastLane){
+	struct queuedConn conn;
+	pthread_mutex_lock(&queue.lock);
+	while(queue.count == 0 && (fastLane || queue.bulkCount == 0)){
+		pthread_cond_wait(fastLane ? &queue.notEmpty : &queue.bulkReady, &queue.lock);
+	}
+	if(!fastLane && queue.bulkCount > 0){
+		conn = queue.bulk[queue.bulkHead];
+		queue.bulkHead = (queue.bulkHead + 1) % queue.limit;
+		queue.bulkCount--;
+	}
+	else{
+		conn = queue.conns[queue.head];
+		queue.head = (queue.head + 1) % queue.limit;
+		queue.count--;
+	}
+	pthread_mutex_unlock(&queue.lock);
+	return conn;
+}
+
+static void finishConnection(struct queuedConn* conn){
+	if(conn->session != NULL){
+		sessionFree(conn->session);
+		free(conn->session);
+	}
+	close(conn->fd);															// Close the existing socket which is connected to the client
+	pthread_mutex_lock(&queue.lock);
+	queue.inFlight--;
+	pthread_cond_signal(&queue.notFull);
+	if(queue.inFlight == 0) pthread_cond_broadcast(&queue.drained);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+// arg is 1 for a fast lane worker
+static void* workerThread(void* arg){
+	struct timeval idle = { config.idleSeconds, 0 };
+	struct queuedConn conn;
+	int fastLane = (int)(intptr_t)arg;
+	while(1){
+		conn = dequeueConnection(fastLane);
+		if(conn.session == NULL){
+			setsockopt(conn.fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));	// a stalled client only holds a worker this long
+			setsockopt(conn.fd, SOL_SOCKET, SO_SNDTIMEO, &idle, sizeof(idle));
+			conn.session = malloc(sizeof(struct otpSession));					// on the heap, so it can change lanes
+			if(conn.session == NULL){
+				fprintf(stderr, "%s error: out of memory for a session\n", config.service->name);
+				finishConnection(&conn);
+				continue;
+			}
+			sessionInit(conn.session, config.service, config.pad);
+			conn.session->startTime = conn.acceptedAt;							// count the time spent queued too
+		}
+		if(serveConnection(&conn, fastLane)) continue;							// now the bulk lane's
+		finishConnection(&conn);
+	}
+	return NULL;
+}
+
+/* Accept connections from listening socket arg (an index into listenFDs) and
+   queue them for the workers, until the daemon drains */
+static void* acceptorThread(void* arg){
+	int listenFD = config.listenFDs[(intptr_t)arg], establishedConnectionFD;
+	socklen_t sizeOfClientInfo;
+	struct sockaddr_in clientAddress;
+	char msg[128];
+
+	while(!daemonDraining()){
+		// Accept a connection, blocking if one is not available until one connects
+		sizeOfClientInfo = sizeof(clientAddress); 							// Get the size of the address for the client that will connect
+		establishedConnectionFD = accept(listenFD, (struct sockaddr *)&clientAddress, &sizeOfClientInfo); // Accept
+		if (establishedConnectionFD < 0){
+			if(errno == EINTR || errno == ECONNABORTED) continue;			// client gave up before we got to it, or drain() woke us
+			if(errno == EMFILE || errno == ENFILE){							// out of descriptors: let workers drain
+				fprintf(stderr, "%s error: on accept: %s\n", config.service->name, strerror(errno));
+				usleep(10000);
+				continue;
+			}
+			snprintf(msg, sizeof(msg), "%s error: on accept", config.service->name);
+			error(msg, 1);
+		}
+		enqueueConnection(establishedConnectionFD);
+	}
+	pthread_mutex_lock(&queue.lock);
+	queue.acceptors--;
+	pthread_cond_broadcast(&queue.drained);
+	pthread_mutex_unlock(&queue.lock);
+	return NULL;
+}
+
+static void runWorkerPool(void){
+	int i;
+	char msg[128];
+	pthread_t thread, *ids;
+
+	queue.limit = config.maxInFlight;
+	queue.conns = malloc(sizeof(struct queuedConn) * queue.limit);
+	queue.bulk = malloc(sizeof(struct queuedConn) * queue.limit);
+	if(queue.conns == NULL || queue.bulk == NULL){
+		snprintf(msg, sizeof(msg), "%s error: allocating connection queue", config.service->name);
+		error(msg, 1);
+	}
+	for(i = 0; i < config.threads; i++){										// the first fastWorkers are the fast lane
+		if(pthread_create(&thread, NULL, workerThread, (void*)(intptr_t)(i < config.fastWorkers)) != 0){
+			snprintf(msg, sizeof(msg), "%s error: starting worker", config.service->name);
+			error(msg, 1);
+		}
+		pthread_detach(thread);
+	}
+	ids = malloc(sizeof(pthread_t) * config.listeners);
+	if(ids == NULL){
+		snprintf(msg, sizeof(msg), "%s error: allocating acceptors", config.service->name);
+		error(msg, 1);
+	}
+	queue.acceptors = config.listeners;
+	ids[0] = pthread_self();												// the main thread is the first acceptor
+	for(i = 1; i < config.listeners; i++){								// left joinable, so their IDs stay good for drain()
+		if(pthread_create(&ids[i], NULL, acceptorThread, (void*)(intptr_t)i) != 0){
+			snprintf(msg, sizeof(msg), "%s error: starting acceptor", config.service->name);
+			error(msg, 1);
+		}
+	}
+	__atomic_store_n(&acceptorIDs, ids, __ATOMIC_RELEASE);
+	acceptorThread((void*)(intptr_t)0);
+
+	pthread_mutex_lock(&queue.lock);										// draining: wait for the last connection
+	while(queue.acceptors > 0 || queue.inFlight > 0){
+		pthread_cond_wait(&queue.drained, &queue.lock);
+	}
+	pthread_mutex_unlock(&queue.lock);
+}
+
+int daemonDraining(void){
+	return __atomic_load_n(&draining, __ATOMIC_ACQUIRE);
+}
+
+void loopFinished(void){
+	int last;
+	pthread_mutex_lock(&loopLock);
+	last = ++loopsFinished == config.threads;
+	pthread_mutex_unlock(&loopLock);
+	if(last) exit(0);
+	pthread_exit(NULL);													// the main thread too: the process lives on without it
+}
+
+static void wakeAcceptor(int sig){
+	(void)sig;															// only here to make accept() fail with EINTR
+}
+
+/* Stop accepting. The event loops see the flag on their next tick; the worker pool
+   acceptors are blocked in accept(), so they are interrupted until all have noticed
+   (a signal that lands just before accept() is called would be missed) */
+static void drain(void){
+	pthread_t* ids;
+	int i, running = 1;
+
+	__atomic_store_n(&draining, 1, __ATOMIC_RELEASE);
+	while(running > 0 && (ids = __atomic_load_n(&acceptorIDs, __ATOMIC_ACQUIRE)) != NULL){
+		for(i = 0; i < config.listeners; i++) pthread_kill(ids[i], SIGUSR1);
+		usleep(10000);
+		pthread_mutex_lock(&queue.lock);
+		running = queue.acceptors;
+		pthread_mutex_unlock(&queue.lock);
+	}
+}
+
+// SIGUSR2 and SIGQUIT are blocked everywhere else and handled here, one at a time
+static void* controlThread(void* arg){
+	sigset_t* signals = arg;
+	int sig;
+
+	while(1){
+		if(sigwait(signals, &sig) != 0) continue;
+		if(sig == SIGUSR2 && !daemonDraining()){
+			restartSpawn(daemonArgv, config.listenFDs, config.listeners, config.service->name);
+		}
+		else if(sig == SIGQUIT && !daemonDraining()){
+			drain();
+		}
+	}
+	return NULL;
+}
+
+static void usage(const char* prog){
+	fprintf(stderr, "USAGE: %s [-w workers] [-e event_loops | -i io_uring_loops] [-c max_in_flight] [-t idle_seconds] [-p padfile] [-s stripe_threads] "
+		"[-f fast_workers] [-l small_limit] [-a acceptors] [-b backlog] [-F] port | -u socketpath\n", prog);
+	fprintf(stderr, "  kill -USR2 hot restarts a running daemon from its binary; kill -QUIT stops it once its connections finish\n");
+	exit(1);
+}
+
+/* with reusePort several sockets can be bound to the same port, each with its own
+   accept queue; the kernel hashes every new connection to one of them */
+static int listenTCP(const char* port, int reusePort){
+	int listenSocketFD, portNumber, yes = 1;
+	struct sockaddr_in serverAddress;
+	char msg[128];
+
+	// Set up the address struct for this process (the server)
+	memset((char *)&serverAddress, '\0', sizeof(serverAddress)); 			// Clear out the address struct
+	portNumber = atoi(port); 												// Get the port number, convert to an integer from a string
+	serverAddress.sin_family = AF_INET; 									// Create a network-capable socket
+	serverAddress.sin_port = htons(portNumber); 							// Store the port number
+	serverAddress.sin_addr.s_addr = INADDR_ANY; 							// Any address is allowed for connection to this process
+
+	// Set up the socket
+	listenSocketFD = socket(AF_INET, SOCK_STREAM, 0); 						// Create the socket
+	if (listenSocketFD < 0){
+		snprintf(msg, sizeof(msg), "%s error: opening socket", config.service->name);
+		error(msg, 1);
+	}
+	setsockopt(listenSocketFD, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));	// allow reuse
+	setsockopt(listenSocketFD, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));	// answers go out whole, so don't hold them back; accepted sockets inherit it
+	if(fastOpen && setsockopt(listenSocketFD, IPPROTO_TCP, TCP_FASTOPEN, &listenBacklog, sizeof(int)) < 0){
+		fprintf(stderr, "%s error: TCP Fast Open: %s\n", config.service->name, strerror(errno));
+	}
+	if(reusePort && setsockopt(listenSocketFD, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) < 0){
+		snprintf(msg, sizeof(msg), "%s error: setting SO_REUSEPORT", config.service->name);
+		error(msg, 1);
+	}
+
+	// Enable the socket to begin listening
+	if (bind(listenSocketFD, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0){ // Connect socket to port
+		snprintf(msg, sizeof(msg), "%s error: on binding", config.service->name);
+		error(msg, 1);
+	}
+	listen(listenSocketFD, listenBacklog); 									// Flip the socket on - it can now queue up to backlog connections
+	return listenSocketFD;
+}
+
+/* -u: listen on a Unix domain socket at path, so clients on the same host skip
+   TCP and name lookup. A leftover socket file nobody answers on is replaced */
+static int listenUnix(const char* path){
+	struct sockaddr_un serverAddress;
+	struct stat info;
+	int listenSocketFD, probe;
+	char msg[160];
+
+	memset(&serverAddress, '\0', sizeof(serverAddress));
+	serverAddress.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(serverAddress.sun_path)){
+		fprintf(stderr, "%s error: socket path too long\n", config.service->name);
+		exit(1);
+	}
+	strcpy(serverAddress.sun_path, path);
+
+	if(stat(path, &info) == 0 && S_ISSOCK(info.st_mode)){
+		probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(probe >= 0 && connect(probe, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) == 0){
+			fprintf(stderr, "%s error: another daemon is listening on %s\n", config.service->name, path);
+			exit(1);
+		}
+		if(probe >= 0) close(probe);
+		unlink(path);														// stale, from a daemon that died
+	}
+
+	listenSocketFD = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenSocketFD < 0){
+		snprintf(msg, sizeof(msg), "%s error: opening socket", config.service->name);
+		error(msg, 1);
+	}
+	if (bind(listenSocketFD, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0){
+		snprintf(msg, sizeof(msg), "%s error: on binding %s", config.service->name, path);
+		error(msg, 1);
+	}
+	listen(listenSocketFD, listenBacklog);
+	return listenSocketFD;
+}
+
+int runDaemon(const struct otpService* service, int argc, char* argv[]){
+	static sigset_t controlSignals;
+	struct sigaction wake;
+	struct rlimit files;
+	int opt, eventLoops = 0, uringLoops = 0, workers, stripeHelpers = 0, unixPath = 0, acceptors = 0, i, inherited;
+	int* handed = NULL;
+	long long smallLimit = DEFAULT_SMALL_LIMIT;
+	const char* padPath = NULL;
+	pthread_t thread;
+
+	config.service = service;
+	config.threads = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+	config.maxInFlight = DEFAULT_INFLIGHT;
+	config.idleSeconds = DEFAULT_IDLE_SECONDS;
+	config.fastWorkers = -1;
+	while((opt = getopt(argc, argv, "w:e:i:c:t:p:s:f:l:a:b:Fu")) != -1){
+		switch(opt){
+			case 'w': config.threads = atoi(optarg); break;
+			case 'e': eventLoops = atoi(optarg); break;
+			case 'i': uringLoops = atoi(optarg); break;
+			case 'c': config.maxInFlight = atoi(optarg); break;
+			case 't': config.idleSeconds = atoi(optarg); break;
+			case 'p': padPath = optarg; break;
+			case 's': stripeHelpers = atoi(optarg); break;
+			case 'f': config.fastWorkers = atoi(optarg); break;
+			case 'l': smallLimit = atoll(optarg); break;
+			case 'a': acceptors = atoi(optarg); break;
+			case 'b': listenBacklog = atoi(optarg); break;
+			case 'F': fastOpen = 1; break;
+			case 'u': unixPath = 1; break;
+			default: usage(argv[0]);
+		}
+	}
+	if(optind != argc - 1 || config.threads < 1 || eventLoops < 0 || uringLoops < 0 || stripeHelpers < 0 || acceptors < 0 ||
+			listenBacklog < 1 || smallLimit < 0 || config.fastWorkers < -1 || (eventLoops > 0 && uringLoops > 0) || config.maxInFlight < 1 || config.idleSeconds < 1){	// Check usage & args
+		usage(argv[0]);
+	}
+	if(config.threads < 2) config.threads = 2;
+	if(config.fastWorkers < 0) config.fastWorkers = config.threads / 4;		// 0, no lanes, below 4 workers
+	if(config.fastWorkers >= config.threads){
+		fprintf(stderr, "%s error: -f must leave at least one bulk worker\n", service->name);
+		exit(1);
+	}
+	config.smallLimit = smallLimit;
+	daemonArgv = argv;
+	inherited = restartInherit(&handed, &predecessor, &ready, service->name);		// a hot restart brings its own sockets
+	if(inherited < 0) exit(1);
+
+	// before any thread starts, so that only the control thread ever takes these
+	sigemptyset(&controlSignals);
+	sigaddset(&controlSignals, SIGUSR2);
+	sigaddset(&controlSignals, SIGQUIT);
+	pthread_sigmask(SIG_BLOCK, &controlSignals, NULL);
+	memset(&wake, 0, sizeof(wake));
+	wake.sa_handler = wakeAcceptor;											// no SA_RESTART: accept() has to return
+	sigaction(SIGUSR1, &wake, NULL);
+
+	if(padPath != NULL){													// keys come from the pad, see otp_pad.c
+		if(padOpen(&pad, padPath, service->consumesPad, service->name, predecessor) < 0) exit(1);
+		config.pad = &pad;
+	}
+
+	statStart();
+	stripeStart(stripeHelpers);												// big requests split over more cores
+
+	// a client hanging up mid-response must not take the whole daemon down
+	signal(SIGPIPE, SIG_IGN);
+
+	// every connection is a descriptor, so allow as many as the hard limit does
+	if(getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max){
+		files.rlim_cur = files.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &files);
+	}
+
+	/* one socket per acceptor; the event loops are their own acceptors, so with -a
+	   each loop gets a socket whatever the count. A Unix socket can't be shared out
+	   by the kernel, so there the acceptors all take turns on the one socket */
+	config.listeners = acceptors > 0 ? acceptors : 1;
+	if(acceptors > 0 && eventLoops + uringLoops > 0) config.listeners = eventLoops + uringLoops;
+	config.listenFDs = malloc(sizeof(int) * config.listeners);
+	if(config.listenFDs == NULL){
+		fprintf(stderr, "%s error: allocating listeners\n", service->name);
+		exit(1);
+	}
+	for(i = 0; i < config.listeners; i++){
+		if(inherited > 0) config.listenFDs[i] = handed[i % inherited];
+		else if(unixPath) config.listenFDs[i] = i > 0 ? config.listenFDs[0] : listenUnix(argv[optind]);
+		else config.listenFDs[i] = listenTCP(argv[optind], acceptors > 0);
+		if(eventLoops > 0){													// several loops may race for one connection
+			fcntl(config.listenFDs[i], F_SETFL, fcntl(config.listenFDs[i], F_GETFL) | O_NONBLOCK);
+		}
+	}
+
+	free(handed);
+
+	if(pthread_create(&thread, NULL, controlThread, &controlSignals) != 0){
+		fprintf(stderr, "%s error: starting control thread\n", service->name);
+		exit(1);
+	}
+	pthread_detach(thread);
+	restartRetire(predecessor);												// up and about to accept: the old daemon can go
+	if(predecessor >= 0) close(predecessor);								// (with -p padOpen() has already seen it out)
+	if(ready >= 0) close(ready);
+
+	if(eventLoops > 0){
+		config.threads = eventLoops;
+		runEventLoops(&config);
+	}
+	else if(uringLoops > 0){
+		workers = config.threads;
+		config.threads = uringLoops;
+		runUringLoops(&config);												// only returns if the kernel can't do io_uring
+		config.threads = workers;
+		runWorkerPool();
+	}
+	else{
+		runWorkerPool();
+	}
+	for(i = 0; i < (unixPath ? 1 : config.listeners); i++){
+		close(config.listenFDs[i]); 										// Close the listening sockets
+	}
+	free(config.listenFDs);
+	return 0;
+}
@@ -0,0 +1,51 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_daemon.h
+* Description: shared server core used by otp_enc_d, otp_dec_d and otp_d. Each
+* daemon describes itself with an otpService and hands control to runDaemon()
+**********************************************************************************/
+#ifndef OTP_DAEMON_H
+#define OTP_DAEMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct padStore;
+struct otpSession;
+struct msghdr;
+
+typedef size_t (*cipherFunc)(char* output, const char* input, const char* key, size_t n);	// chars done, see otp_cipher.h
+
+struct otpService {
+	const char* name;						// program name used in error messages
+	const char* handshake;					// string the client must send, echoed back on success
+	const char* operation;					// "encryption" or "decryption", for error messages
+	cipherFunc transform;					// otpEncrypt() or otpDecrypt()
+	int consumesPad;						// with -p, each pad range is used once (encryption only)
+	int requestOp;							// REQUEST_ENCRYPT or REQUEST_DECRYPT, for header mode
+	const struct otpService* const* operations;	// otp_d: the services it serves requests for, NULL-terminated
+};
+
+// settings shared by the I/O engines, filled in from the command line
+struct daemonConfig {
+	const struct otpService* service;
+	int* listenFDs;							// listening socket of each acceptor, the same one repeated with -u
+	int listeners;							// acceptor threads, or one per loop with -e and -i
+	int threads;							// worker threads, or event loop threads with -e
+	int fastWorkers;						// workers kept for small requests, see runWorkerPool()
+	uint64_t smallLimit;					// largest request the fast lane serves
+	int maxInFlight;						// connections open at once
+	int idleSeconds;						// drop clients that stall this long
+	struct padStore* pad;					// -p pad store, or NULL
+};
+
+int runDaemon(const struct otpService* service, int argc, char* argv[]);
+int recvSession(struct otpSession* session, int socketFD, char* buf, int len);	// recv() that also picks up a passed memfd
+void takeDescriptor(struct otpSession* session, struct msghdr* msg);			// the memfd from a recvmsg(), if any
+int daemonDraining(void);										// SIGQUIT came: accept nothing new
+void loopFinished(void);										// an event loop has drained; does not return
+void runEventLoops(const struct daemonConfig* config);			// otp_epoll.c
+void runUringLoops(const struct daemonConfig* config);			// otp_uring.c, returns if io_uring is unavailable
+
+#endif
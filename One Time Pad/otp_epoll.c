@@ -0,0 +1,250 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_epoll.c
+* Description: event-driven engine for the daemons. Each loop thread owns an epoll
+* instance and the non-blocking connections it accepted, and steps their sessions
+* forward as the sockets become readable or writable, so a slow client only costs
+* its session and buffers rather than a whole worker. A draining loop takes its
+* listening socket out of epoll and ends with its last connection
+**********************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "otp_daemon.h"
+#include "otp_session.h"
+
+#define MAX_EVENTS 256
+
+struct eventConn {
+	int fd;
+	unsigned events;										// what we last asked epoll for
+	time_t lastActive;
+	struct otpSession session;
+	struct eventConn *prev, *next;
+};
+
+struct eventLoop {
+	const struct daemonConfig* config;
+	int epollFD;
+	int listenFD;											// this loop's listening socket, see daemonConfig
+	int count, limit;										// open connections, and this loop's share of the cap
+	int listening;											// listen socket currently registered
+	struct eventConn* conns;								// every open connection, for the idle sweep
+};
+
+// take new connections or not; once the daemon drains, never again
+static void setListening(struct eventLoop* loop, int on){
+	struct epoll_event ev;
+	if(daemonDraining()) on = 0;
+	if(loop->listening == on) return;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;					// wake one loop per new connection, not all of them
+	ev.data.ptr = NULL;
+	epoll_ctl(loop->epollFD, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, loop->listenFD, &ev);
+	loop->listening = on;
+}
+
+static void closeConn(struct eventLoop* loop, struct eventConn* c){
+	close(c->fd);											// also removes it from epoll
+	sessionFree(&c->session);
+	if(c->prev) c->prev->next = c->next;
+	else loop->conns = c->next;
+	if(c->next) c->next->prev = c->prev;
+	free(c);
+	loop->count--;
+	setListening(loop, loop->count < loop->limit);
+}
+
+/* Move a connection as far as its socket allows, then re-arm epoll for whatever
+   the session is waiting on. Returns -1 once the connection has been closed */
+static int pump(struct eventLoop* loop, struct eventConn* c){
+	struct epoll_event ev;
+	struct iovec out[2];
+	char* in;
+	int n, progress = 1;
+	unsigned want;
+
+	while(progress){
+		progress = 0;
+		while((n = sessionSendData(&c->session, out)) > 0){
+			n = writev(c->fd, out, n);
+			if(n < 0){
+				if(errno == EINTR) continue;
+				if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+				fprintf(stderr, "%s error: writing to socket: %s\n", loop->config->service->name, strerror(errno));
+				closeConn(loop, c);
+				return -1;
+			}
+			if(sessionSent(&c->session, n) < 0){
+				closeConn(loop, c);
+				return -1;
+			}
+			progress = 1;
+		}
+		if(sessionFinished(&c->session)){
+			closeConn(loop, c);
+			return -1;
+		}
+		while((n = sessionRecvSpace(&c->session, &in)) > 0){
+			n = recvSession(&c->session, c->fd, in, n);
+			if(n < 0){
+				if(errno == EINTR) continue;
+				if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+				fprintf(stderr, "%s error: reading from socket: %s\n", loop->config->service->name, strerror(errno));
+				closeConn(loop, c);
+				return -1;
+			}
+			if(sessionReceived(&c->session, n) < 0){
+				closeConn(loop, c);
+				return -1;
+			}
+			progress = 1;
+			if(sessionSendData(&c->session, out) > 0) break;		// answer before reading further
+		}
+	}
+
+	want = 0;
+	if(sessionRecvSpace(&c->session, &in) > 0) want |= EPOLLIN;
+	if(sessionSendData(&c->session, out) > 0) want |= EPOLLOUT;
+	if(want != c->events){
+		memset(&ev, 0, sizeof(ev));
+		ev.events = want;
+		ev.data.ptr = c;
+		epoll_ctl(loop->epollFD, EPOLL_CTL_MOD, c->fd, &ev);
+		c->events = want;
+	}
+	return 0;
+}
+
+static void acceptReady(struct eventLoop* loop){
+	struct epoll_event ev;
+	struct eventConn* c;
+	int fd;
+
+	while(loop->count < loop->limit){
+		fd = accept4(loop->listenFD, NULL, NULL, SOCK_NONBLOCK);
+		if(fd < 0){
+			if(errno == EINTR || errno == ECONNABORTED) continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK){
+				fprintf(stderr, "%s error: on accept: %s\n", loop->config->service->name, strerror(errno));
+			}
+			break;
+		}
+		c = calloc(1, sizeof(*c));
+		if(c == NULL){
+			close(fd);
+			break;
+		}
+		c->fd = fd;
+		c->events = EPOLLIN;
+		c->lastActive = time(NULL);
+		sessionInit(&c->session, loop->config->service, loop->config->pad);
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		if(epoll_ctl(loop->epollFD, EPOLL_CTL_ADD, fd, &ev) < 0){
+			sessionFree(&c->session);
+			free(c);
+			close(fd);
+			continue;
+		}
+		c->next = loop->conns;
+		if(c->next) c->next->prev = c;
+		loop->conns = c;
+		loop->count++;
+	}
+	setListening(loop, loop->count < loop->limit);
+}
+
+// drop connections that have made no progress for idleSeconds
+static void sweepIdle(struct eventLoop* loop, time_t now){
+	struct eventConn *c = loop->conns, *next;
+	while(c != NULL){
+		next = c->next;
+		if(now - c->lastActive > loop->config->idleSeconds){
+			fprintf(stderr, "%s error: reading from socket: client idle too long\n", loop->config->service->name);
+			closeConn(loop, c);
+		}
+		c = next;
+	}
+}
+
+static void* eventLoopThread(void* arg){
+	struct eventLoop* loop = arg;
+	struct epoll_event events[MAX_EVENTS];
+	struct eventConn* c;
+	time_t now, lastSweep = time(NULL);
+	int i, n;
+
+	while(1){
+		n = epoll_wait(loop->epollFD, events, MAX_EVENTS, 1000);
+		if(n < 0 && errno != EINTR){
+			perror("epoll_wait");
+			exit(1);
+		}
+		now = time(NULL);
+		for(i = 0; i < n; i++){
+			if(events[i].data.ptr == NULL){
+				acceptReady(loop);
+				continue;
+			}
+			c = events[i].data.ptr;
+			c->lastActive = now;
+			pump(loop, c);
+		}
+		if(now != lastSweep){
+			sweepIdle(loop, now);
+			lastSweep = now;
+		}
+		if(daemonDraining()){											// checked at least once a second
+			if(loop->listening){
+				setListening(loop, 0);
+				acceptReady(loop);										// a wakeup we took is no other daemon's to see
+			}
+			if(loop->count == 0) break;
+		}
+	}
+	close(loop->epollFD);
+	loopFinished();
+	return NULL;
+}
+
+void runEventLoops(const struct daemonConfig* config){
+	struct eventLoop* loops = calloc(config->threads, sizeof(struct eventLoop));
+	pthread_t thread;
+	int i;
+
+	if(loops == NULL){
+		perror("runEventLoops");
+		exit(1);
+	}
+	for(i = 0; i < config->threads; i++){
+		loops[i].config = config;
+		loops[i].listenFD = config->listenFDs[i % config->listeners];
+		loops[i].limit = config->maxInFlight / config->threads;
+		if(loops[i].limit < 1) loops[i].limit = 1;
+		loops[i].epollFD = epoll_create1(0);
+		if(loops[i].epollFD < 0){
+			fprintf(stderr, "%s error: epoll_create1: %s\n", config->service->name, strerror(errno));
+			exit(1);
+		}
+		setListening(&loops[i], 1);
+		if(i > 0){													// the calling thread runs loop 0
+			if(pthread_create(&thread, NULL, eventLoopThread, &loops[i]) != 0){
+				fprintf(stderr, "%s error: starting event loop\n", config->service->name);
+				exit(1);
+			}
+			pthread_detach(thread);
+		}
+	}
+	eventLoopThread(&loops[0]);
+}
@@ -0,0 +1,195 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_pad.c
+* Description: pad store for the daemons' -p option. The ledger holds a magic
+* string and two big-endian 64-bit marks. The reserved mark is pushed ahead in
+* PAD_RESERVE steps and synced before any range past it is used, so a crash can
+* waste some pad but never hand out a range twice. The issued mark is the exact
+* end of the ranges handed out so far. It is rewritten, unsynced, with each one,
+* and decryption refuses any range that ends past it
+**********************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "otp_pad.h"
+#include "otp_proto.h"
+#include "otp_restart.h"
+
+struct ledgerRecord {
+	char magic[8];
+	uint64_t reserved;							// big-endian
+	uint64_t issued;							// big-endian; older ledgers end before it
+};
+
+static int writeLedger(struct padStore* pad, uint64_t reserved, uint64_t issued){
+	struct ledgerRecord record;
+	memset(&record, 0, sizeof(record));
+	strcpy(record.magic, PAD_LEDGER_MAGIC);
+	record.reserved = htobe64(reserved);
+	record.issued = htobe64(issued);
+	if(pwrite(pad->ledgerFD, &record, sizeof(record), 0) != sizeof(record) || fdatasync(pad->ledgerFD) < 0){
+		return -1;
+	}
+	pad->reserved = reserved;
+	return 0;
+}
+
+// only the decrypting daemon needs it, so it goes to the page cache and is not synced
+static int writeIssued(struct padStore* pad, uint64_t issued){
+	uint64_t mark = htobe64(issued);
+	return pwrite(pad->ledgerFD, &mark, sizeof(mark), offsetof(struct ledgerRecord, issued)) == sizeof(mark) ? 0 : -1;
+}
+
+/* A daemon that only decrypts reads the issued mark of the one that encrypts, once
+   the ledger exists, and only when a request ends past the mark it last saw */
+static void readIssued(struct padStore* pad){
+	struct ledgerRecord record;
+
+	if(pad->ledgerFD < 0) pad->ledgerFD = open(pad->ledgerPath, O_RDONLY | O_CLOEXEC);
+	if(pad->ledgerFD >= 0 && pread(pad->ledgerFD, &record, sizeof(record), 0) == sizeof(record) &&
+			memcmp(record.magic, PAD_LEDGER_MAGIC, sizeof(PAD_LEDGER_MAGIC)) == 0){
+		pad->next = be64toh(record.issued);
+	}
+}
+
+/* The ledger lives next to the pad and only the encrypting daemon keeps one. In a
+   hot restart the old daemon holds it until it has drained, and only then is the
+   mark read: no range is handed out by both */
+static int openLedger(struct padStore* pad, const char* name, int predecessor){
+	const char* ledgerPath = pad->ledgerPath;
+	struct ledgerRecord record;
+	int n;
+
+	pad->ledgerFD = open(ledgerPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if(pad->ledgerFD < 0){
+		fprintf(stderr, "%s error: opening ledger '%s': %s\n", name, ledgerPath, strerror(errno));
+		return -1;
+	}
+	if(flock(pad->ledgerFD, LOCK_EX | LOCK_NB) < 0){					// two encrypting daemons would reuse ranges
+		if(errno != EWOULDBLOCK || predecessor < 0){
+			fprintf(stderr, "%s error: ledger '%s' is in use by another daemon\n", name, ledgerPath);
+			return -1;
+		}
+		restartRetire(predecessor);
+		while(flock(pad->ledgerFD, LOCK_EX) < 0){
+			if(errno != EINTR){
+				fprintf(stderr, "%s error: locking ledger '%s': %s\n", name, ledgerPath, strerror(errno));
+				return -1;
+			}
+		}
+	}
+	n = pread(pad->ledgerFD, &record, sizeof(record), 0);
+	if(n == 0){
+		pad->reserved = 0;												// fresh pad
+	}
+	else if((n == sizeof(record) || n == offsetof(struct ledgerRecord, issued)) &&
+			memcmp(record.magic, PAD_LEDGER_MAGIC, sizeof(PAD_LEDGER_MAGIC)) == 0){
+		pad->reserved = be64toh(record.reserved);
+	}
+	else{
+		fprintf(stderr, "%s error: '%s' is not a pad ledger\n", name, ledgerPath);
+		return -1;
+	}
+	pad->next = pad->reserved;											// whatever was reserved may have been used
+	if(writeLedger(pad, pad->reserved, pad->next) < 0){				// and none of it will be again
+		fprintf(stderr, "%s error: writing ledger '%s': %s\n", name, ledgerPath, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int padOpen(struct padStore* pad, const char* path, int consume, const char* name, int predecessor){
+	struct stat info;
+	void* data;
+	int fd;
+
+	memset(pad, 0, sizeof(*pad));
+	pad->consume = consume;
+	pad->ledgerFD = -1;
+	pthread_mutex_init(&pad->lock, NULL);
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0 || fstat(fd, &info) < 0){
+		fprintf(stderr, "%s error: opening pad '%s': %s\n", name, path, strerror(errno));
+		return -1;
+	}
+	pad->ledgerPath = malloc(strlen(path) + sizeof(".ledger"));
+	sprintf(pad->ledgerPath, "%s.ledger", path);
+	if(info.st_size == 0){
+		fprintf(stderr, "%s error: pad '%s' is empty\n", name, path);
+		return -1;
+	}
+	data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);															// the mapping keeps the file
+	if(data == MAP_FAILED){
+		fprintf(stderr, "%s error: mapping pad '%s': %s\n", name, path, strerror(errno));
+		return -1;
+	}
+	pad->data = data;
+	pad->size = info.st_size;
+	if(pad->data[pad->size - 1] == '\n') pad->size--;					// keygen ends the pad with a newline
+	if(consume){
+		madvise(data, info.st_size, MADV_SEQUENTIAL);					// ranges go out front to back
+		if(openLedger(pad, name, predecessor) < 0) return -1;
+	}
+	return 0;
+}
+
+/* Find the range of the pad to use as the key for a request of length bytes. For
+   decryption the client names the offset it got when encrypting, and the range
+   must already have been handed out: otherwise its key would be known before the
+   message it is going to hide. For encryption PAD_NEXT takes the next unused
+   range; an explicit offset has to be unused */
+const char* padReserve(struct padStore* pad, uint64_t offset, uint64_t length, int consume, uint64_t* start){
+	uint64_t end, mark;
+	const char* why = NULL;
+
+	if(!consume || !pad->consume){										// decryption only reads, whoever owns the ledger
+		if(offset == PAD_NEXT) return "decryption needs the pad offset";
+		if(offset > pad->size || length > pad->size - offset) return "range is past the end of the pad";
+		end = offset + length;
+		pthread_mutex_lock(&pad->lock);
+		if(end > pad->next && !pad->consume) readIssued(pad);			// the encrypting daemon may have gone on
+		if(end > pad->next) why = "pad range not handed out yet";
+		pthread_mutex_unlock(&pad->lock);
+		if(why == NULL) *start = offset;
+		return why;
+	}
+
+	pthread_mutex_lock(&pad->lock);
+	if(offset == PAD_NEXT) offset = pad->next;
+	if(offset < pad->next){
+		why = "pad range already used";
+	}
+	else if(offset > pad->size || length > pad->size - offset){
+		why = "pad exhausted";
+	}
+	else{
+		end = offset + length;
+		if(end > pad->reserved){										// record the range before using it
+			mark = pad->reserved + PAD_RESERVE;
+			if(mark < end) mark = end;
+			if(mark > pad->size) mark = pad->size;
+			if(writeLedger(pad, mark, end) < 0) why = "writing pad ledger failed";
+		}
+		else if(writeIssued(pad, end) < 0){
+			why = "writing pad ledger failed";
+		}
+		if(why == NULL){
+			pad->next = end;
+			*start = offset;
+		}
+	}
+	pthread_mutex_unlock(&pad->lock);
+	return why;
+}
@@ -0,0 +1,37 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_pad.h
+* Description: pad store for the daemons' -p option. One large keygen file is
+* mapped into memory and requests use ranges of it as their key, so clients send
+* only their text. The encrypting daemon hands out each range once and records
+* how far it has gone in a small ledger file next to the pad. Decryption only
+* gets ranges below that point, so no key is given out before its message exists
+**********************************************************************************/
+#ifndef OTP_PAD_H
+#define OTP_PAD_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define PAD_RESERVE (16 * 1024 * 1024)			// ledger is written once per this much pad used
+#define PAD_LEDGER_MAGIC "OTPPAD1"
+
+struct padStore {
+	const char* data;							// the mapped pad
+	uint64_t size;								// usable bytes, without keygen's newline
+	int consume;								// keeps a ledger: some requests use ranges up (encryption)
+	int ledgerFD;								// read only without consume, and opened once it exists
+	char* ledgerPath;
+	uint64_t next;								// first byte never handed out, as far as this daemon knows
+	uint64_t reserved;							// ledger mark: all of the pad below it counts as used
+	pthread_mutex_t lock;
+};
+
+/* -1 after reporting why. predecessor is a pidfd for a daemon being hot restarted,
+   or -1: it is told to drain and the ledger is taken over once it lets go */
+int padOpen(struct padStore* pad, const char* path, int consume, const char* name, int predecessor);
+const char* padReserve(struct padStore* pad, uint64_t offset, uint64_t length, int consume, uint64_t* start);	// NULL, or why not
+
+#endif
@@ -0,0 +1,109 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_pool.c
+* Description: payload buffer pool for the daemons. Classes under POOL_ARENA are
+* carved from 2 MiB arenas that are never given back. Their memory is bounded by
+* the most buffers of each class that were ever in use at once. Bigger buffers
+* are mapped on their own, 2 MiB aligned, and unmapped once both caches are full.
+* Everything is advised to use transparent huge pages, so a 16 MiB request faults
+* in 8 pages the first time instead of 4096, and none when it is reused. Free
+* buffers are linked through their first word
+**********************************************************************************/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "otp_pool.h"
+#include "otp_stats.h"
+
+struct poolCache {
+	char* free[POOL_CLASSES];
+	size_t bytes;										// held in free
+};
+
+static __thread struct poolCache local;
+static struct poolCache shared;
+static pthread_mutex_t sharedLock = PTHREAD_MUTEX_INITIALIZER;
+
+// the class that fits size, or POOL_CLASSES for one too big to keep
+static int classOf(size_t size){
+	int k = 0;
+	while(k < POOL_CLASSES && ((size_t)1 << (POOL_MIN_SHIFT + k)) < size) k++;
+	return k;
+}
+
+static size_t classSize(int k, size_t size){
+	return k < POOL_CLASSES ? (size_t)1 << (POOL_MIN_SHIFT + k) : (size + POOL_ARENA - 1) & ~(size_t)(POOL_ARENA - 1);
+}
+
+static void push(struct poolCache* cache, int k, char* buf, size_t bytes){
+	*(char**)buf = cache->free[k];
+	cache->free[k] = buf;
+	cache->bytes += bytes;
+}
+
+static char* pop(struct poolCache* cache, int k, size_t bytes){
+	char* buf = cache->free[k];
+	if(buf == NULL) return NULL;
+	cache->free[k] = *(char**)buf;
+	cache->bytes -= bytes;
+	return buf;
+}
+
+// bytes (a multiple of POOL_ARENA) of fresh memory on a huge page boundary
+static char* mapAligned(size_t bytes){
+	char *map = mmap(NULL, bytes + POOL_ARENA, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0), *start;
+	uintptr_t skip;
+
+	if(map == MAP_FAILED) return NULL;
+	skip = (POOL_ARENA - (uintptr_t)map % POOL_ARENA) % POOL_ARENA;
+	start = map + skip;
+	if(skip > 0) munmap(map, skip);										// trim to the boundary at both ends
+	munmap(start + bytes, POOL_ARENA - skip);
+	madvise(start, bytes, MADV_HUGEPAGE);
+	statAdd(STAT_POOL_BYTES, bytes);
+	return start;
+}
+
+char* poolGet(size_t size){
+	int k = classOf(size), i;
+	size_t bytes = classSize(k, size);
+	char *buf, *arena;
+
+	if(k < POOL_CLASSES){
+		if((buf = pop(&local, k, bytes)) != NULL) return buf;
+		pthread_mutex_lock(&sharedLock);
+		buf = pop(&shared, k, bytes);
+		pthread_mutex_unlock(&sharedLock);
+		if(buf != NULL) return buf;
+	}
+	if(bytes >= POOL_ARENA) return mapAligned(bytes);
+
+	arena = mapAligned(POOL_ARENA);										// the rest of the arena waits in this thread's cache
+	if(arena == NULL) return NULL;
+	for(i = POOL_ARENA / bytes - 1; i > 0; i--) push(&local, k, arena + i * bytes, bytes);
+	return arena;
+}
+
+void poolPut(char* buf, size_t size){
+	int k = classOf(size);
+	size_t bytes = classSize(k, size);
+
+	if(buf == NULL) return;
+	if(k < POOL_CLASSES && local.bytes + bytes <= POOL_THREAD_CACHE){
+		push(&local, k, buf, bytes);
+		return;
+	}
+	if(k < POOL_CLASSES){
+		pthread_mutex_lock(&sharedLock);
+		if(bytes < POOL_ARENA || shared.bytes + bytes <= POOL_SHARED_CACHE){	// part of an arena can't be unmapped
+			push(&shared, k, buf, bytes);
+			buf = NULL;
+		}
+		pthread_mutex_unlock(&sharedLock);
+		if(buf == NULL) return;
+	}
+	munmap(buf, bytes);
+	statAdd(STAT_POOL_BYTES, -(long long)bytes);
+}
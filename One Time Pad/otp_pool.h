@@ -0,0 +1,25 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_pool.h
+* Description: payload buffers for the daemons' sessions. Sizes round up to a
+* power of two, and freed buffers are kept for the next request of the same size
+* class. They go first to a cache of the thread that freed them and then to a
+* shared one, so steady load stops asking the kernel for memory. Buffers are not
+* cleared: every byte is received or ciphered before it is read
+**********************************************************************************/
+#ifndef OTP_POOL_H
+#define OTP_POOL_H
+
+#include <stddef.h>
+
+#define POOL_MIN_SHIFT 12								// smallest class: 4 KiB
+#define POOL_CLASSES 13									// up to 16 MiB, one MAX_PAYLOAD request
+#define POOL_ARENA (2 * 1024 * 1024)					// one huge page; smaller classes are carved out of these
+#define POOL_THREAD_CACHE (32 * 1024 * 1024)			// bytes of free buffers a thread keeps to itself
+#define POOL_SHARED_CACHE (256 * 1024 * 1024)			// bytes kept beyond those before big buffers go back
+
+char* poolGet(size_t size);								// NULL if out of memory
+void poolPut(char* buf, size_t size);					// size as given to poolGet(); NULL is ignored
+
+#endif
@@ -0,0 +1,120 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_proto.h
+* Description: wire format shared by the clients and the daemons.
+*
+* Legacy mode: the client sends "encrypt" (or "decrypt") with its terminator and
+* the daemon echoes it back, then the client sends a native int size (counting a
+* terminator), that many text bytes and that many key bytes, and reads back that
+* many result bytes.
+*
+* Stream mode: the handshake is "encrypt stream" and is echoed the same way.
+* After that the connection carries any number of requests, and the client may
+* send them all without waiting for answers. A request is one or more chunks,
+* each a streamHeader followed by length text bytes and then length key bytes,
+* all with the same id; its final chunk has STREAM_LAST set (and may be empty).
+* The daemon answers every chunk, in order, with a streamHeader carrying the same
+* id and flags followed by length result bytes, as soon as the chunk's key is in.
+* The client ends the connection by closing its side after a final chunk. Errors
+* come back as a STREAM_ERROR header followed by a length byte message, after
+* which the daemon closes the connection.
+*
+* Pad mode: the handshake is "encrypt pad" and everything is as in stream mode,
+* except that no key bytes are sent: the key is a range of the daemon's pad file.
+* The first chunk of each request has a padRequest between its header and its
+* text, giving the pad offset and the request's total length. For encryption the
+* offset is normally PAD_NEXT and the daemon picks the next unused range; the
+* first answer of the request carries a padRequest with the offset it used, which
+* the client needs again to decrypt.
+*
+* Byte mode: the handshake is "encrypt bytes" (or "decrypt bytes") and the wire
+* format is exactly stream mode, but text and key are any bytes at all and are
+* combined by XOR, so files need no encoding first.
+*
+* Memfd mode: the handshake is "encrypt memfd" (add " bytes" for byte mode) and
+* only works over a Unix domain socket. Text and key never cross the socket; they
+* go through a memfd of MEMFD_SLOTS slots, each MEMFD_SLOT text bytes followed by
+* MEMFD_SLOT key bytes, which the client seals against shrinking and sends
+* (SCM_RIGHTS) along with its first chunk header. Chunks are framed as in stream
+* mode but are headers alone, at most MEMFD_SLOT long, and the n-th chunk on the
+* connection (counting from 0) is in slot n % MEMFD_SLOTS. The daemon writes the
+* result over the slot's text in place and answers with the chunk's header alone,
+* after which the client may fill the slot again
+*
+* Packed mode: add " packed" to a stream or pad handshake (not bytes or memfd).
+* Chunk lengths still count chars, but the text, key and result of a chunk each
+* travel as PACKED_SIZE(length) bytes: every char becomes a 5 bit value ('A' is
+* 0, ' ' is 26), eight values make a 40 bit group sent as 5 bytes with the first
+* value in the lowest bits, and a short last group takes only the bytes it needs,
+* padded with zero bits. Values 27-31 are invalid characters. A daemon that
+* doesn't know the option rejects the handshake, and the client can reconnect
+* and go without
+*
+* Header mode: instead of a text handshake the client may open with a
+* requestHeader (REQUEST_MAGIC, REQUEST_VERSION, the operation, flags and a 64
+* bit length, all big-endian) and send its request right behind it; there is no
+* echo to wait for. With REQUEST_STREAM the length is 0 and the rest of the
+* connection is in stream mode, with REQUEST_BYTES, REQUEST_PAD and
+* REQUEST_PACKED standing in for the handshake options; a header the daemon
+* won't take is answered with a STREAM_ERROR frame. Without it, length text
+* bytes and length key bytes follow (no terminators, at most 16 MiB) and the
+* answer is a requestHeader with the same operation and length, then length
+* result bytes, after which the client may send another header or close. Such a
+* request that fails gets a header with REQUEST_ERROR set instead, whose length
+* is that of the message after it. After any error answer the daemon reads and
+* throws away what the client is still sending until it closes, so the answer
+* isn't lost to a connection reset
+**********************************************************************************/
+#ifndef OTP_PROTO_H
+#define OTP_PROTO_H
+
+#include <stdint.h>
+
+#define STREAM_OPTION "stream"
+#define STREAM_MAX_CHUNK (1024 * 1024)			// largest chunk a daemon accepts
+#define STREAM_CHUNK STREAM_MAX_CHUNK			// chunk size the clients send: big enough for -s to split
+
+#define STREAM_LAST 0x1						// final chunk of a request
+#define STREAM_ERROR 0x2
+
+#define BYTES_OPTION "bytes"
+#define PAD_OPTION "pad"
+#define PAD_NEXT UINT64_MAX					// let the encrypting daemon choose the range
+#define MEMFD_OPTION "memfd"
+#define MEMFD_SLOT (1024 * 1024)				// text bytes per memfd slot
+#define MEMFD_SLOTS 4
+#define MEMFD_SIZE (MEMFD_SLOTS * 2 * MEMFD_SLOT)
+#define PACKED_OPTION "packed"
+#define PACKED_SIZE(n) (((n) * 5 + 7) / 8)		// wire bytes for n chars in packed mode
+
+#define REQUEST_MAGIC 0x4F545048				// "OTPH"; no text handshake starts with 'O'
+#define REQUEST_VERSION 1
+#define REQUEST_ENCRYPT 1						// requestHeader operations
+#define REQUEST_DECRYPT 2
+#define REQUEST_STREAM 0x1						// requestHeader flags
+#define REQUEST_BYTES 0x2
+#define REQUEST_PAD 0x4
+#define REQUEST_PACKED 0x8
+#define REQUEST_ERROR 0x8000					// answers only
+
+struct requestHeader {							// big-endian
+	uint32_t magic;
+	uint8_t version;
+	uint8_t operation;
+	uint16_t flags;
+	uint64_t length;							// chars of text, or 0 with REQUEST_STREAM
+};
+
+struct padRequest {								// big-endian, see htobe64()
+	uint64_t offset;
+	uint64_t length;							// text bytes in the whole request
+};
+
+struct streamHeader {							// all fields in network byte order
+	uint32_t id;								// request the chunk belongs to, chosen by the client
+	uint32_t length;
+	uint32_t flags;
+};
+
+#endif
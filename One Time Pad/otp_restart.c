@@ -0,0 +1,169 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_restart.c
+* Description: hot restart for the daemons. The old daemon forks twice, so the new
+* one is nobody's child and init reaps it, closes every descriptor but the
+* listening sockets in the grandchild and execs its own argv there, with the
+* sockets named in HANDOVER_ENV. The new daemon picks them up instead of binding
+**********************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/pidfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "otp_restart.h"
+
+extern char** environ;
+
+static int starting = -1;												// our end of the last successor's ready pipe
+
+int restartInherit(int** fds, int* predecessor, int* ready, const char* name){
+	const char* handover = getenv(HANDOVER_ENV);
+	char* end;
+	int count = 0, listening, i;
+	socklen_t size = sizeof(listening);
+	long value;
+
+	*predecessor = *ready = -1;
+	if(handover == NULL) return 0;
+	*fds = malloc(sizeof(int) * (strlen(handover) / 2 + 1));			// at least two chars per socket
+	if(*fds == NULL){
+		fprintf(stderr, "%s error: allocating listeners\n", name);
+		return -1;
+	}
+	value = strtol(handover, &end, 10);
+	if(value <= 0 || *end != ':') goto bad;
+	*predecessor = pidfd_open(value, 0);								// it waits for our SIGQUIT, so the pid is still its own;
+																		// -1 if it died anyway, and then there is no one to tell
+	value = strtol(end + 1, &end, 10);
+	if(value < 0 || *end != ':' || fcntl(value, F_SETFD, FD_CLOEXEC) < 0) goto bad;
+	*ready = value;
+	do{
+		value = strtol(end + 1, &end, 10);
+		if(value < 0 || (*end != ',' && *end != '\0')) goto bad;
+		(*fds)[count++] = value;
+	}while(*end == ',');
+	for(i = 0; i < count; i++){											// make sure they really are listening sockets
+		if(getsockopt((*fds)[i], SOL_SOCKET, SO_ACCEPTCONN, &listening, &size) < 0 || !listening) goto bad;
+		fcntl((*fds)[i], F_SETFD, FD_CLOEXEC);							// until the next restart hands them on
+	}
+	unsetenv(HANDOVER_ENV);
+	return count;
+
+bad:
+	fprintf(stderr, "%s error: bad %s '%s'\n", name, HANDOVER_ENV, handover);
+	return -1;
+}
+
+void restartRetire(int predecessor){
+	if(predecessor >= 0) pidfd_send_signal(predecessor, SIGQUIT, NULL, 0);
+}
+
+// ascending, so the gaps between them can go to close_range()
+static void sortDescriptors(int* fds, int count){
+	int i, j, fd;
+	for(i = 1; i < count; i++){
+		fd = fds[i];
+		for(j = i; j > 0 && fds[j - 1] > fd; j--) fds[j] = fds[j - 1];
+		fds[j] = fd;
+	}
+}
+
+/* Whether the last successor is still starting: it holds the write end of the
+   ready pipe until it has sent us SIGQUIT, or until it dies trying */
+static int stillStarting(void){
+	struct pollfd ready = { starting, POLLIN, 0 };
+	if(starting < 0) return 0;
+	if(poll(&ready, 1, 0) == 0) return 1;
+	close(starting);
+	starting = -1;
+	return 0;
+}
+
+/* Everything the child needs is built here first: after fork() only one thread is
+   left, so the child keeps to calls that are safe in that state */
+void restartSpawn(char* argv[], const int* fds, int count, const char* name){
+	char *handover, **env;
+	char failed[160];
+	int *keep, kept = 0, envCount = 0, i, j, length, ready[2];
+	size_t envLength = strlen(HANDOVER_ENV);
+	sigset_t none;
+	pid_t child;
+
+	if(stillStarting()){												// a second one would share the sockets
+		fprintf(stderr, "%s error: hot restart already in progress, ignoring SIGUSR2\n", name);
+		return;
+	}
+	if(pipe2(ready, O_CLOEXEC) < 0){
+		fprintf(stderr, "%s error: hot restart: pipe: %s\n", name, strerror(errno));
+		return;
+	}
+	handover = malloc(strlen(HANDOVER_ENV) + 36 + count * 12);
+	keep = malloc(sizeof(int) * (count + 1));
+	while(environ[envCount] != NULL) envCount++;
+	env = malloc(sizeof(char*) * (envCount + 2));
+	if(handover == NULL || keep == NULL || env == NULL){
+		fprintf(stderr, "%s error: hot restart: out of memory\n", name);
+		close(ready[0]);
+		close(ready[1]);
+		free(handover);
+		free(keep);
+		free(env);
+		return;
+	}
+
+	length = sprintf(handover, "%s=%d:%d:", HANDOVER_ENV, (int)getpid(), ready[1]);
+	keep[kept++] = ready[1];
+	for(i = 0; i < count; i++){											// -u repeats one socket for every acceptor
+		for(j = 1; j < kept && keep[j] != fds[i]; j++);
+		if(j < kept) continue;
+		keep[kept++] = fds[i];
+		length += sprintf(handover + length, "%s%d", kept > 2 ? "," : "", fds[i]);
+	}
+	sortDescriptors(keep, kept);
+	for(i = j = 0; i < envCount; i++){									// drop the one this daemon was started with, if any
+		if(strncmp(environ[i], HANDOVER_ENV, envLength) != 0 || environ[i][envLength] != '=') env[j++] = environ[i];
+	}
+	env[j++] = handover;
+	env[j] = NULL;
+	length = snprintf(failed, sizeof(failed), "%s error: hot restart: could not run %s\n", name, argv[0]);
+	if(length >= (int)sizeof(failed)) length = sizeof(failed) - 1;
+	sigemptyset(&none);
+
+	child = fork();
+	if(child < 0){
+		fprintf(stderr, "%s error: hot restart: fork: %s\n", name, strerror(errno));
+	}
+	else if(child == 0){
+		if(fork() != 0) _exit(0);										// the successor goes to init, not to us
+		pthread_sigmask(SIG_SETMASK, &none, NULL);						// exec keeps the mask, and ours blocks the control signals
+		for(i = 0, j = 3; i < kept; i++){								// close all but stdio and the sockets
+			if(keep[i] > j) close_range(j, keep[i] - 1, 0);
+			if(keep[i] >= j) j = keep[i] + 1;
+			fcntl(keep[i], F_SETFD, 0);
+		}
+		close_range(j, ~0U, 0);
+		execvpe(argv[0], argv, env);
+		write(STDERR_FILENO, failed, length);
+		_exit(127);
+	}
+	else{
+		waitpid(child, NULL, 0);
+	}
+	close(ready[1]);													// the successor has the only copy now
+	if(child < 0) close(ready[0]);
+	else starting = ready[0];
+	free(handover);
+	free(keep);
+	free(env);
+}
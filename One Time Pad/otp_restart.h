@@ -0,0 +1,31 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_restart.h
+* Description: hot restart for the daemons. On SIGUSR2 a daemon starts a new copy
+* of its binary with the same arguments and lets it inherit the listening sockets.
+* Once the new daemon is up it sends the old one SIGQUIT, and the old one stops
+* accepting, finishes the connections it has and exits. The sockets stay open the
+* whole time, so new clients wait in the backlog instead of being refused
+**********************************************************************************/
+#ifndef OTP_RESTART_H
+#define OTP_RESTART_H
+
+#include <sys/types.h>
+
+#define HANDOVER_ENV "OTP_HANDOVER"				// "pid:ready:fd,fd,...": the daemon being replaced, see
+												// restartInherit(), and its sockets
+
+/* The listening sockets handed over by the daemon being replaced, in its order,
+   and a pidfd for that daemon, or -1. ready is the end of a pipe to close once the
+   old daemon has been told to go: until then it refuses another SIGUSR2. Returns
+   how many sockets (0 for a normal start, -1 after reporting a bad handover) */
+int restartInherit(int** fds, int* predecessor, int* ready, const char* name);
+
+// send the daemon being replaced SIGQUIT; harmless once it has gone, whatever has its pid now
+void restartRetire(int predecessor);
+
+// start the successor, unless the last one is still starting; it inherits fds and nothing else
+void restartSpawn(char* argv[], const int* fds, int count, const char* name);
+
+#endif
@@ -0,0 +1,680 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_session.c
+* Description: protocol state machine for one daemon connection. The phases are
+* the same as they always were (handshake, size header, payload, key, response),
+* but each phase only says how many bytes it needs so any I/O engine can drive it.
+* Stream mode loops over chunk header, text and key instead, answering each chunk
+* as soon as it is complete, for as many requests as the client pipelines down
+* the connection (see otp_proto.h). Pad mode skips the key and reads it from the
+* daemon's pad store instead, and byte mode swaps the mod 27 kernel for XOR.
+* Memfd mode ciphers chunks in place in shared memory the client handed over, and
+* packed mode unpacks text and key on the way in and packs the result going out
+**********************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "otp_session.h"
+#include "otp_cipher.h"
+#include "otp_pool.h"
+#include "otp_stats.h"
+#include "otp_stripe.h"
+
+// point the receive side at the buffer the current phase fills
+static void expect(struct otpSession* s, enum sessionState state, void* buf, int want){
+	s->state = state;
+	s->rxBuf = buf;
+	s->rxWant = want;
+	s->rxLen = 0;
+}
+
+static void queueSend(struct otpSession* s, const char* buf, int len){
+	s->txBuf = buf;
+	s->txFrameLen = 0;
+	s->txLen = len;
+	s->txSent = 0;
+}
+
+// an answer: the first frameLen bytes of txFrame, then len bytes of buf
+static void queueAnswer(struct otpSession* s, int frameLen, const char* buf, int len){
+	s->txBuf = buf;
+	s->txFrameLen = frameLen;
+	s->txLen = frameLen + len;
+	s->txSent = 0;
+}
+
+static void countRequest(const struct otpSession* s){
+	statAdd(STAT_REQUESTS, 1);
+	statAdd(s->op->requestOp == REQUEST_ENCRYPT ? STAT_ENCRYPTIONS : STAT_DECRYPTIONS, 1);
+}
+
+/* The operation a request names, by its handshake word or its header code: the
+   daemon's own, or for otp_d one of those it serves. NULL if there is none */
+static const struct otpService* findOperation(const struct otpService* svc, const char* word, int len, int requestOp){
+	const struct otpService* const single[] = { svc, NULL };
+	const struct otpService* const* op;
+
+	for(op = svc->operations != NULL ? svc->operations : single; *op != NULL; op++){
+		if(word != NULL ? (int)strlen((*op)->handshake) == len && strncmp(word, (*op)->handshake, len) == 0 :
+				(*op)->requestOp == requestOp){
+			return *op;
+		}
+	}
+	return NULL;
+}
+
+// header mode: the client's own operation comes back, even one this daemon doesn't do
+static void replyHeader(const struct otpSession* s, struct requestHeader* header, int flags, uint64_t length){
+	header->magic = htonl(REQUEST_MAGIC);
+	header->version = REQUEST_VERSION;
+	header->operation = s->request.operation;
+	header->flags = htons(flags);
+	header->length = htobe64(length);
+}
+
+/* Tell the client what went wrong, in whichever framing it is reading answers in,
+   then hang up. The client may have pipelined more behind what failed, so that is
+   read and thrown away first: closing on unread input would reset the connection,
+   and the reset can beat the error to the client */
+static void errorAnswer(struct otpSession* s, const char* msg){
+	struct streamHeader frame;
+	struct requestHeader header;
+	int front = s->streaming ? sizeof(frame) : sizeof(header), len = strlen(msg);
+
+	if(len > (int)sizeof(s->errorFrame) - front) len = sizeof(s->errorFrame) - front;
+	if(s->streaming){
+		frame.id = s->inHeader.id;
+		frame.length = htonl(len);
+		frame.flags = htonl(STREAM_ERROR);
+		memcpy(s->errorFrame, &frame, sizeof(frame));
+	}
+	else{
+		replyHeader(s, &header, REQUEST_ERROR, len);
+		memcpy(s->errorFrame, &header, sizeof(header));
+	}
+	memcpy(s->errorFrame + front, msg, len);
+	queueSend(s, s->errorFrame, front + len);
+	s->drainInput = 1;
+	s->carryLen = s->carryUsed = 0;									// whatever came with the handshake is thrown away too
+	expect(s, SESSION_CLOSING, NULL, 0);
+	fprintf(stderr, "%s error: %s\n", s->svc->name, msg);
+}
+
+// stream and header mode: a request failed
+static void streamError(struct otpSession* s, const char* msg){
+	statAdd(STAT_ERRORS, 1);
+	errorAnswer(s, msg);
+}
+
+void sessionInit(struct otpSession* s, const struct otpService* svc, struct padStore* pad){
+	memset(s, 0, sizeof(*s));
+	s->svc = svc;
+	s->op = svc;
+	s->pad = pad;
+	s->passedFD = -1;
+	s->startTime = statNow();
+	statAdd(STAT_ACCEPTED, 1);
+	statAdd(STAT_ACTIVE, 1);
+	expect(s, SESSION_HANDSHAKE, s->handshake, HANDSHAKE_SIZE - 1);		// leave room for a terminator
+}
+
+// anything but a clean finish or a hang-up between requests loses a request
+static int midRequest(const struct otpSession* s){
+	switch(s->state){
+		case SESSION_DONE:
+		case SESSION_CLOSING:
+			return 0;
+		case SESSION_DRAINING:
+			return 0;
+		case SESSION_HANDSHAKE:
+		case SESSION_SIZE:
+		case SESSION_STREAM_HEADER:
+		case SESSION_REQUEST_HEADER:
+			return s->rxLen > 0 || s->inRequest;
+		default:
+			return 1;
+	}
+}
+
+// back to the pool, see reserveBuffers()
+static void releaseBuffers(struct otpSession* s){
+	poolPut(s->input, s->bufferSize);
+	poolPut(s->key, s->bufferSize);
+	poolPut(s->output, s->bufferSize);
+	s->input = s->key = s->output = NULL;
+	s->bufferSize = 0;
+}
+
+void sessionFree(struct otpSession* s){
+	if(midRequest(s)) statAdd(STAT_ERRORS, 1);
+	statAdd(STAT_ACTIVE, -1);
+	releaseBuffers(s);
+	free(s->report);
+	s->report = NULL;
+	if(s->passedFD >= 0) close(s->passedFD);
+	if(s->shared != NULL) munmap(s->shared, MEMFD_SIZE);
+	s->passedFD = -1;
+	s->shared = NULL;
+}
+
+// a request (or stream chunk) starts with its first byte, not when the client went quiet
+static void markReceive(struct otpSession* s){
+	if(s->rxLen == 0 && (s->state == SESSION_SIZE || s->state == SESSION_STREAM_HEADER || s->state == SESSION_REQUEST_HEADER)){
+		s->recvStart = statNow();
+	}
+}
+
+/* Time the kernel, and the answer from here until its last byte is sent. The
+   kernel checks text and key as it goes, so the daemon never trusts the client's
+   own check: -1 if either strays outside the alphabet, after a stream error (or
+   just a message in legacy mode, which has no way to report one) */
+static int cipher(struct otpSession* s, char* output, const char* input, const char* key, int length){
+	double start = statNow();
+	size_t done = stripeCipher(s->transform, output, input, key, length);
+	char msg[80];
+
+	s->sendStart = statNow();
+	s->timingSend = 1;
+	statTime(PHASE_RECEIVE, s->recvStart);
+	statTime(PHASE_CIPHER, start);
+	if(done < (size_t)length){
+		snprintf(msg, sizeof(msg), "invalid character at offset %llu", (unsigned long long)(s->requestBytes + done));
+		if(s->streaming || s->headerMode) streamError(s, msg);
+		else fprintf(stderr, "%s error: %s\n", s->svc->name, msg);
+		return -1;
+	}
+	s->requestBytes += length;
+	return 0;
+}
+
+/* Buffers for a request or chunk of size bytes, from the pool, all three in the
+   same size class: the answer's header goes out from txFrame. They are kept for
+   the next one and only traded in for bigger ones, and never cleared: every byte
+   is received or ciphered before anything reads it */
+static int reserveBuffers(struct otpSession* s, int size){
+	int keyed = !s->padMode;											// pad mode reads the key from the pad
+	if(size <= s->bufferSize && (s->key != NULL || !keyed)) return 0;
+	if(size < s->bufferSize) size = s->bufferSize;
+	releaseBuffers(s);
+	s->input = poolGet(size);
+	s->key = keyed ? poolGet(size) : NULL;
+	s->output = poolGet(size);
+	s->bufferSize = size;
+	if(s->input == NULL || (keyed && s->key == NULL) || s->output == NULL){
+		releaseBuffers(s);
+		return -1;
+	}
+	return 0;
+}
+
+/* Apply the words after the operation: "stream", "pad", "bytes", "memfd" or "packed", where
+   any option at all means stream framing. Returns 0 for an unknown option or one
+   that doesn't go with the others */
+static int handshakeOptions(struct otpSession* s, const char* options){
+	char words[HANDSHAKE_SIZE], *word, *rest;
+
+	s->transform = s->op->transform;
+	if(options == NULL) return 1;										// legacy mode
+	s->streaming = 1;
+	strcpy(words, options + 1);
+	for(word = strtok_r(words, " ", &rest); word != NULL; word = strtok_r(NULL, " ", &rest)){
+		if(strcmp(word, PAD_OPTION) == 0) s->padMode = 1;
+		else if(strcmp(word, BYTES_OPTION) == 0) s->transform = otpXor;	// XOR undoes itself
+		else if(strcmp(word, MEMFD_OPTION) == 0) s->memfdMode = 1;
+		else if(strcmp(word, PACKED_OPTION) == 0) s->packed = 1;
+		else if(strcmp(word, STREAM_OPTION) != 0) return 0;
+	}
+	if(s->packed && (s->memfdMode || s->transform == otpXor)) return 0;	// only letters pack, and only on the wire
+	return !(s->padMode && (s->memfdMode || s->transform == otpXor));	// the pad holds letters, and isn't shared memory
+}
+
+// legacy and header mode: buffers for a whole request of payloadSize bytes
+static int allocRequest(struct otpSession* s){
+	if(reserveBuffers(s, s->payloadSize) < 0){
+		fprintf(stderr, "%s error: out of memory for %d byte request\n", s->svc->name, s->payloadSize);
+		return -1;
+	}
+	return 0;
+}
+
+/* Header mode: a requestHeader is in. Its flags do what the handshake options do,
+   and anything wrong with it is answered in the framing the client asked for */
+static int requestReceived(struct otpSession* s){
+	const struct otpService* op = findOperation(s->svc, NULL, 0, s->request.operation);
+	int flags = ntohs(s->request.flags);
+	uint64_t length = be64toh(s->request.length);
+	char msg[80];
+
+	if(op != NULL) s->op = op;
+	s->transform = flags & REQUEST_BYTES ? otpXor : s->op->transform;
+	s->streaming = (flags & REQUEST_STREAM) != 0;
+	s->padMode = (flags & REQUEST_PAD) != 0;
+	s->packed = (flags & REQUEST_PACKED) != 0;
+	if(ntohl(s->request.magic) != REQUEST_MAGIC || s->request.version != REQUEST_VERSION){
+		statAdd(STAT_REJECTED, 1);
+		errorAnswer(s, "unsupported request header version");
+		return 0;
+	}
+	if(op == NULL){													// wrong client type for this daemon
+		statAdd(STAT_REJECTED, 1);
+		snprintf(msg, sizeof(msg), "invalid %s request: this daemon only does %s",
+			s->request.operation == REQUEST_ENCRYPT ? "encryption" : s->request.operation == REQUEST_DECRYPT ? "decryption" : "unknown",
+			s->svc->operation);
+		errorAnswer(s, msg);
+		return 0;
+	}
+	if(((s->padMode || s->packed) && (!s->streaming || s->transform == otpXor)) || (s->streaming && length != 0)){
+		statAdd(STAT_REJECTED, 1);
+		errorAnswer(s, "request header flags don't go together");
+		return 0;
+	}
+	if(s->streaming){
+		expect(s, SESSION_STREAM_HEADER, &s->inHeader, sizeof(s->inHeader));
+		return 0;
+	}
+	if(length == 0 || length > MAX_PAYLOAD){
+		streamError(s, "bad request length");
+		return 0;
+	}
+	s->payloadSize = length;
+	if(allocRequest(s) < 0) return -1;
+	expect(s, SESSION_PAYLOAD, s->input, s->payloadSize);
+	return 0;
+}
+
+// header mode: cipher a whole request and answer it behind a requestHeader of its own
+static int answerRequest(struct otpSession* s){
+	struct requestHeader header;
+
+	if(cipher(s, s->output, s->input, s->key, s->payloadSize) < 0) return 0;	// already answered with the error
+	replyHeader(s, &header, 0, s->payloadSize);
+	memcpy(s->txFrame, &header, sizeof(header));
+	queueAnswer(s, sizeof(header), s->output, s->payloadSize);
+	countRequest(s);
+	s->requestBytes = 0;
+	expect(s, SESSION_REQUEST_HEADER, &s->request, sizeof(s->request));
+	return 0;
+}
+
+/* Check the handshake once its terminator shows up. Returns 1 when the phase is
+   over, 0 while more bytes are needed and -1 if the connection should be dropped */
+static int handshakeReceived(struct otpSession* s){
+	char* end = memchr(s->handshake, '\0', s->rxLen);
+	const struct otpService* op;
+	char* option;
+	int used, opLen;
+
+	if(s->handshake[0] == (char)(REQUEST_MAGIC >> 24)){				// header mode: no terminator, no echo
+		if(s->rxLen < (int)sizeof(s->request)) return 0;
+		memcpy(&s->request, s->handshake, sizeof(s->request));
+		s->carryLen = s->rxLen - sizeof(s->request);						// the request itself came along too
+		s->carryUsed = 0;
+		memcpy(s->carry, s->handshake + sizeof(s->request), s->carryLen);
+		s->headerMode = 1;
+		statTime(PHASE_HANDSHAKE, s->startTime);
+		s->recvStart = statNow();
+		return requestReceived(s) < 0 ? -1 : 1;
+	}
+	if(end == NULL){
+		if(s->rxLen < s->rxWant) return 0;								// keep reading
+		fprintf(stderr, "%s error: handshake too long\n", s->svc->name);
+		return -1;
+	}
+	if(strcmp(s->handshake, STATS_HANDSHAKE) == 0){						// report instead of a request
+		s->report = malloc(STATS_REPORT_SIZE);
+		if(s->report == NULL) return -1;
+		queueSend(s, s->report, statReport(s->report, STATS_REPORT_SIZE, s->svc->name));
+		expect(s, SESSION_CLOSING, NULL, 0);
+		return 1;
+	}
+	option = strchr(s->handshake, ' ');									// "encrypt", or "encrypt" and its options
+	opLen = option != NULL ? option - s->handshake : (int)strlen(s->handshake);
+	op = findOperation(s->svc, s->handshake, opLen, 0);
+	if(op != NULL) s->op = op;
+	if(op == NULL || !handshakeOptions(s, option)){
+		queueSend(s, "invalid", 8);										// wrong client type for this daemon
+		statAdd(STAT_REJECTED, 1);
+		fprintf(stderr, "%s error: invalid %s socket\n", s->svc->name, s->svc->operation);
+		expect(s, SESSION_CLOSING, NULL, 0);
+		return 1;
+	}
+
+	// anything past the terminator belongs to the next phase
+	used = end - s->handshake + 1;
+	s->carryLen = s->rxLen - used;
+	s->carryUsed = 0;
+	memcpy(s->carry, s->handshake + used, s->carryLen);
+
+	queueSend(s, s->handshake, used);									// verify proper connection by echoing
+	statTime(PHASE_HANDSHAKE, s->startTime);
+	if(s->streaming){
+		expect(s, SESSION_STREAM_HEADER, &s->inHeader, sizeof(s->inHeader));
+	}
+	else{
+		expect(s, SESSION_SIZE, &s->payloadSize, sizeof(s->payloadSize));
+	}
+	return 1;
+}
+
+/* Queue the answer to a chunk, whose result is already in place at data: the
+   chunk's own header (same id, length and flags) and, on the first answer of a pad
+   mode request, the pad range it used. Both go in txFrame */
+static void answerChunk(struct otpSession* s, const char* data, int length){
+	struct padRequest range;
+	int frameLen = sizeof(s->inHeader);
+
+	memcpy(s->txFrame, &s->inHeader, sizeof(s->inHeader));
+	if(s->sendRange){
+		range.offset = htobe64(s->padStart);
+		range.length = s->padIn.length;
+		memcpy(s->txFrame + frameLen, &range, sizeof(range));
+		frameLen += sizeof(range);
+		s->sendRange = 0;
+	}
+	queueAnswer(s, frameLen, data, length);
+	if(ntohl(s->inHeader.flags) & STREAM_LAST){
+		s->inRequest = 0;
+		s->requestBytes = 0;
+		countRequest(s);
+	}
+	expect(s, SESSION_STREAM_HEADER, &s->inHeader, sizeof(s->inHeader));
+}
+
+// a chunk header is in: set up for its text
+static void chunkHeader(struct otpSession* s){
+	int length = ntohl(s->inHeader.length);
+
+	if(length == 0){													// empty final chunk, e.g. an empty file
+		answerChunk(s, NULL, 0);
+	}
+	else if(length < 0 || length > STREAM_MAX_CHUNK){
+		streamError(s, "chunk too large");
+	}
+	else if(s->padMode && (uint64_t)length > s->padEnd - s->padNext){
+		streamError(s, "chunk runs past the request's pad range");
+	}
+	else if(reserveBuffers(s, length) < 0){
+		streamError(s, "out of memory");
+	}
+	else if(s->packed){													// unpacked from the output buffer, which is free until the answer
+		expect(s, SESSION_STREAM_TEXT, s->output, PACKED_SIZE(length));
+	}
+	else{
+		expect(s, SESSION_STREAM_TEXT, s->input, length);
+	}
+}
+
+/* The chunk's text (and key) are in: cipher and answer. Packed mode ciphers the
+   text in place and packs the result into the answer */
+static void finishChunk(struct otpSession* s, const char* key, int length){
+	char* result = s->output;
+
+	if(!s->packed){
+		if(cipher(s, result, s->input, key, length) < 0) return;
+		answerChunk(s, result, length);
+		return;
+	}
+	if(cipher(s, s->input, s->input, key, length) < 0) return;
+	otpPack(result, s->input, length);
+	answerChunk(s, result, PACKED_SIZE(length));
+}
+
+// memfd mode: map the slots that came with the first chunk header
+static const char* mapShared(struct otpSession* s){
+	struct stat info;
+	int seals = fcntl(s->passedFD, F_GET_SEALS);
+	char* map;
+
+	if(seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(s->passedFD, &info) < 0 || info.st_size < MEMFD_SIZE){
+		return "memfd must be sealed against shrinking and hold every slot";
+	}
+	map = mmap(NULL, MEMFD_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, s->passedFD, 0);
+	if(map == MAP_FAILED) return "could not map the memfd";
+	s->shared = map;
+	return NULL;
+}
+
+/* Memfd mode: the chunk's text and key are already in its slot. The seal means the
+   client can't shrink the memfd under the mapping, and the answer is just the
+   chunk's header once the text has been overwritten */
+static void memfdChunk(struct otpSession* s){
+	int length = ntohl(s->inHeader.length);
+	char* slot;
+	const char* why;
+
+	if(s->shared == NULL){
+		why = s->passedFD < 0 ? "memfd mode needs the memfd with the first chunk" : mapShared(s);
+		if(why != NULL){
+			streamError(s, why);
+			return;
+		}
+	}
+	if(s->passedFD >= 0){												// done with it once it is mapped
+		close(s->passedFD);
+		s->passedFD = -1;
+	}
+	if(length < 0 || length > MEMFD_SLOT){
+		streamError(s, "chunk too large for a memfd slot");
+		return;
+	}
+	slot = s->shared + (size_t)(s->sharedChunks++ % MEMFD_SLOTS) * 2 * MEMFD_SLOT;
+	if(cipher(s, slot, slot, slot + MEMFD_SLOT, length) < 0) return;	// the kernels are safe in place
+	memcpy(s->txFrame, &s->inHeader, sizeof(s->inHeader));
+	queueAnswer(s, sizeof(s->inHeader), NULL, 0);
+	if(ntohl(s->inHeader.flags) & STREAM_LAST){
+		countRequest(s);
+		s->requestBytes = 0;
+	}
+	expect(s, SESSION_STREAM_HEADER, &s->inHeader, sizeof(s->inHeader));
+}
+
+// the current phase has all of its bytes: move to the next one
+static int advance(struct otpSession* s){
+	const char* why;
+	int length;
+
+	switch(s->state){
+		case SESSION_SIZE:
+			if(s->payloadSize <= 0 || s->payloadSize > MAX_PAYLOAD){
+				fprintf(stderr, "%s error: bad size header from client\n", s->svc->name);
+				return -1;
+			}
+			if(allocRequest(s) < 0) return -1;
+			expect(s, SESSION_PAYLOAD, s->input, s->payloadSize);
+			return 0;
+		case SESSION_PAYLOAD:
+			expect(s, SESSION_KEY, s->key, s->payloadSize);
+			return 0;
+		case SESSION_REQUEST_HEADER:
+			return requestReceived(s);
+		case SESSION_KEY:
+			if(s->headerMode) return answerRequest(s);
+			if(cipher(s, s->output, s->input, s->key, s->payloadSize - 1) < 0) return -1;	// size counts the terminator
+			s->output[s->payloadSize - 1] = '\0';
+			queueSend(s, s->output, s->payloadSize);					// send back the result
+			countRequest(s);
+			expect(s, SESSION_RESPONSE, NULL, 0);
+			return 0;
+		case SESSION_STREAM_HEADER:
+			if(s->padMode && !s->inRequest){							// a new request starts with its pad range
+				expect(s, SESSION_PAD_REQUEST, &s->padIn, sizeof(s->padIn));
+				return 0;
+			}
+			if(s->memfdMode){
+				memfdChunk(s);
+				return 0;
+			}
+			chunkHeader(s);
+			return 0;
+		case SESSION_PAD_REQUEST:
+			if(s->pad == NULL){
+				streamError(s, "daemon has no pad store");
+				return 0;
+			}
+			why = padReserve(s->pad, be64toh(s->padIn.offset), be64toh(s->padIn.length), s->op->consumesPad, &s->padStart);
+			if(why != NULL){
+				streamError(s, why);
+				return 0;
+			}
+			s->padNext = s->padStart;
+			s->padEnd = s->padStart + be64toh(s->padIn.length);
+			s->inRequest = 1;
+			s->sendRange = 1;
+			chunkHeader(s);
+			return 0;
+		case SESSION_STREAM_TEXT:
+			length = ntohl(s->inHeader.length);
+			if(s->packed) otpUnpack(s->input, s->rxBuf, length);
+			if(!s->padMode){
+				expect(s, SESSION_STREAM_KEY, s->packed ? s->rxBuf : s->key, s->rxWant);
+				return 0;
+			}
+			finishChunk(s, s->pad->data + s->padNext, length);			// key comes straight from the mapped pad
+			s->padNext += length;
+			return 0;
+		case SESSION_STREAM_KEY:
+			length = ntohl(s->inHeader.length);
+			if(s->packed) otpUnpack(s->key, s->rxBuf, length);
+			finishChunk(s, s->key, length);							// answer this chunk right away
+			return 0;
+		default:
+			return -1;
+	}
+}
+
+// replay bytes that were read together with the handshake, once output has drained
+static int feedCarry(struct otpSession* s){
+	int n;
+	while(s->carryUsed < s->carryLen && s->rxLen < s->rxWant && s->txLen == 0){
+		n = s->rxWant - s->rxLen;
+		if(n > s->carryLen - s->carryUsed) n = s->carryLen - s->carryUsed;
+		markReceive(s);
+		memcpy(s->rxBuf + s->rxLen, s->carry + s->carryUsed, n);
+		s->carryUsed += n;
+		s->rxLen += n;
+		if(s->rxLen == s->rxWant && advance(s) < 0) return -1;
+	}
+	return 0;
+}
+
+int sessionRecvSpace(struct otpSession* s, char** buf){
+	if(s->txLen > 0 || s->carryUsed < s->carryLen) return 0;			// finish what we have first
+	*buf = s->rxBuf + s->rxLen;
+	return s->rxWant - s->rxLen;
+}
+
+int sessionReceived(struct otpSession* s, int n){
+	int r;
+	if(s->state == SESSION_DRAINING){									// thrown away, until the client hangs up
+		if(n <= 0){
+			expect(s, SESSION_DONE, NULL, 0);
+			return 0;
+		}
+		statAdd(STAT_BYTES_IN, n);
+		s->drained += n;
+		return s->drained > DRAIN_LIMIT ? -1 : 0;
+	}
+	if(n == 0 && (s->state == SESSION_STREAM_HEADER || s->state == SESSION_REQUEST_HEADER) && s->rxLen == 0){	// client is done with the connection
+		expect(s, SESSION_DONE, NULL, 0);
+		return 0;
+	}
+	if(n <= 0){															// client went away mid-request
+		if(s->state != SESSION_HANDSHAKE || s->rxLen > 0){
+			fprintf(stderr, "%s error: reading from socket: short request\n", s->svc->name);
+		}
+		return -1;
+	}
+	markReceive(s);
+	s->rxLen += n;
+	statAdd(STAT_BYTES_IN, n);
+	if(s->state == SESSION_HANDSHAKE){
+		r = handshakeReceived(s);
+		if(r <= 0) return r;
+	}
+	else if(s->rxLen < s->rxWant){
+		return 0;
+	}
+	else if(advance(s) < 0){
+		return -1;
+	}
+	return feedCarry(s);
+}
+
+int sessionSendData(struct otpSession* s, struct iovec iov[2]){
+	int n = 0, at = s->txSent;
+
+	if(at < s->txFrameLen){
+		iov[n].iov_base = s->txFrame + at;
+		iov[n++].iov_len = s->txFrameLen - at;
+		at = s->txFrameLen;
+	}
+	if(at < s->txLen){
+		iov[n].iov_base = (char*)s->txBuf + (at - s->txFrameLen);
+		iov[n++].iov_len = s->txLen - at;
+	}
+	return n;
+}
+
+int sessionSent(struct otpSession* s, int n){
+	s->txSent += n;
+	statAdd(STAT_BYTES_OUT, n);
+	if(s->txSent < s->txLen) return 0;
+	s->txBuf = NULL;
+	s->txFrameLen = s->txLen = s->txSent = 0;
+	if(s->timingSend){
+		statTime(PHASE_SEND, s->sendStart);
+		s->timingSend = 0;
+	}
+	if(s->state == SESSION_CLOSING && s->drainInput){
+		expect(s, SESSION_DRAINING, s->handshake, HANDSHAKE_SIZE);
+		return 0;
+	}
+	if(s->state == SESSION_RESPONSE || s->state == SESSION_CLOSING){
+		s->state = SESSION_DONE;
+		return 0;
+	}
+	return feedCarry(s);
+}
+
+int sessionFinished(const struct otpSession* s){
+	return s->state == SESSION_DONE;
+}
+
+int sessionWantsDescriptor(const struct otpSession* s){
+	return s->memfdMode && s->shared == NULL && s->state == SESSION_STREAM_HEADER;
+}
+
+void sessionTakeDescriptor(struct otpSession* s, int fd){
+	if(s->passedFD >= 0) close(s->passedFD);							// only one per connection
+	s->passedFD = fd;
+}
+
+/* Size of the request being received, for engines that schedule by size. A stream
+   request that goes on past its current chunk counts as larger than any limit */
+uint64_t sessionRequestSize(const struct otpSession* s){
+	uint64_t length = ntohl(s->inHeader.length);
+	int last = ntohl(s->inHeader.flags) & STREAM_LAST;
+
+	switch(s->state){
+		case SESSION_PAYLOAD:
+		case SESSION_KEY:
+			return s->payloadSize;
+		case SESSION_STREAM_HEADER:
+			if(!s->memfdMode || s->txLen == 0) return 0;				// memfd chunks are ciphered once their header is in
+			return last ? length : UINT64_MAX;
+		case SESSION_STREAM_TEXT:
+		case SESSION_STREAM_KEY:
+			if(s->padMode) return be64toh(s->padIn.length);
+			return last ? s->requestBytes + length : UINT64_MAX;
+		default:
+			return 0;
+	}
+}
@@ -0,0 +1,92 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_session.h
+* Description: per-connection protocol state machine shared by the daemon's I/O
+* engines. A session never touches the socket itself: the engine asks it where to
+* put the next bytes it receives and what bytes are waiting to be sent, so the
+* same protocol code runs under blocking workers and the epoll event loop. A
+* session takes no input while it has output waiting, which bounds its memory to
+* one request (or one stream chunk) and keeps the protocol in lockstep
+**********************************************************************************/
+#ifndef OTP_SESSION_H
+#define OTP_SESSION_H
+
+#include <sys/uio.h>
+#include "otp_daemon.h"
+#include "otp_proto.h"
+#include "otp_pad.h"
+
+#define HANDSHAKE_SIZE 64
+#define MAX_PAYLOAD (1 << 24)						// largest size header we will allocate for
+#define ANSWER_FRAME (sizeof(struct streamHeader) + sizeof(struct padRequest))	// the most header sent ahead of an answer
+#define DRAIN_LIMIT (16 * 1024 * 1024)				// most bytes thrown away after an error answer
+
+enum sessionState {
+	SESSION_HANDSHAKE,								// waiting for "encrypt"/"decrypt"
+	SESSION_SIZE,									// waiting for the int size header
+	SESSION_PAYLOAD,								// receiving plaintext or cipher
+	SESSION_KEY,									// receiving key
+	SESSION_RESPONSE,								// sending the result
+	SESSION_STREAM_HEADER,							// stream mode: waiting for a chunk header
+	SESSION_STREAM_TEXT,							// stream mode: receiving a chunk of text
+	SESSION_STREAM_KEY,								// stream mode: receiving the chunk's key
+	SESSION_PAD_REQUEST,							// pad mode: receiving a request's pad offset and length
+	SESSION_REQUEST_HEADER,							// header mode: waiting for the next requestHeader
+	SESSION_CLOSING,								// sending a rejection, then close
+	SESSION_DRAINING,								// error sent: discarding input until the client closes
+	SESSION_DONE
+};
+
+struct otpSession {
+	const struct otpService* svc;
+	const struct otpService* op;					// the operation asked for: svc, or one of svc->operations
+	enum sessionState state;
+	char* rxBuf;									// where the next received bytes go
+	int rxWant, rxLen;
+	char txFrame[ANSWER_FRAME];						// header going out ahead of txBuf
+	const char* txBuf;								// bytes waiting to go out
+	int txFrameLen, txLen, txSent;					// txLen and txSent count the frame too
+	char handshake[HANDSHAKE_SIZE];
+	char carry[HANDSHAKE_SIZE];						// bytes that arrived with the handshake
+	int carryLen, carryUsed;
+	int payloadSize;
+	char *input, *key, *output;
+	int streaming;									// handshake asked for stream mode
+	cipherFunc transform;							// the service's kernel, or XOR in byte mode
+	int bufferSize;									// capacity of input, key and output, from otp_pool.c
+	struct streamHeader inHeader;
+	struct padStore* pad;							// NULL unless the daemon was started with -p
+	int padMode;									// handshake asked for pad mode
+	int inRequest;									// pad mode: past the first chunk of a request
+	int sendRange;									// pad mode: next answer tells the client its range
+	struct padRequest padIn;
+	uint64_t padStart, padNext, padEnd;				// current request's pad range and the next key byte in it
+	uint64_t requestBytes;							// text of the current request ciphered so far, for error offsets
+	double startTime, recvStart, sendStart;			// for the stats latency phases
+	int timingSend;									// an answer (not the handshake echo) is going out
+	char* report;									// answer to a "stats" request
+	int memfdMode;									// handshake asked for memfd mode
+	int passedFD;									// memfd mode: descriptor that came with a header, or -1
+	char* shared;									// memfd mode: the client's slots, mapped once
+	unsigned sharedChunks;							// chunks served so far, which picks the next slot
+	int packed;										// handshake asked for the packed wire format
+	int headerMode;									// opened with a requestHeader, not a text handshake
+	struct requestHeader request;
+	int drainInput;									// read until the client closes once the error is out
+	uint64_t drained;
+	char errorFrame[sizeof(struct requestHeader) + 128];	// fits either kind of error header
+};
+
+void sessionInit(struct otpSession* s, const struct otpService* svc, struct padStore* pad);
+void sessionFree(struct otpSession* s);
+int sessionRecvSpace(struct otpSession* s, char** buf);		// bytes wanted next, 0 if none or still sending
+int sessionReceived(struct otpSession* s, int n);			// account for n bytes; -1 means drop the connection
+int sessionSendData(struct otpSession* s, struct iovec iov[2]);	// pieces waiting to be sent, 0 if none
+int sessionSent(struct otpSession* s, int n);				// -1 means drop the connection
+int sessionFinished(const struct otpSession* s);
+int sessionWantsDescriptor(const struct otpSession* s);		// next bytes may carry a memfd
+void sessionTakeDescriptor(struct otpSession* s, int fd);	// the session now owns fd
+uint64_t sessionRequestSize(const struct otpSession* s);	// announced size of the request coming in, 0 if not known yet
+
+#endif
@@ -0,0 +1,113 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_stats.c
+* Description: counters and histograms behind the "stats" request. Every thread
+* that records anything gets its own shard, so workers and event loops never
+* fight over a cache line; the report adds the shards up. Updates are relaxed
+* atomics, which cost next to nothing on a shard nobody else writes to and keep
+* the totals right when threads past STAT_SHARDS have to share shard 0
+**********************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "otp_stats.h"
+#include "otp_cipher.h"
+
+#define STAT_SHARDS 256
+
+struct statShard {
+	long long counters[STAT_COUNTERS];
+	long long buckets[STAT_PHASES][STAT_BUCKETS];
+	long long totalMicros[STAT_PHASES];
+} __attribute__((aligned(64)));
+
+static const char* phaseNames[STAT_PHASES] = { "handshake", "receive", "cipher", "send" };
+static struct statShard shards[STAT_SHARDS];
+static int shardsUsed;
+static __thread struct statShard* myShard;
+static double started = -1;
+
+double statNow(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static struct statShard* shard(void){
+	int i;
+	if(myShard == NULL){
+		i = __atomic_fetch_add(&shardsUsed, 1, __ATOMIC_RELAXED);
+		myShard = &shards[i < STAT_SHARDS ? i : 0];
+	}
+	return myShard;
+}
+
+void statStart(void){
+	started = statNow();
+}
+
+void statAdd(enum statCounter counter, long long n){
+	__atomic_fetch_add(&shard()->counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void statTime(enum statPhase phase, double since){
+	struct statShard* s = shard();
+	long long micros = (statNow() - since) * 1e6;
+	int bucket = 0;
+
+	if(micros < 0) micros = 0;
+	while(bucket < STAT_BUCKETS - 1 && (micros >> (bucket + 1)) != 0) bucket++;
+	__atomic_fetch_add(&s->buckets[phase][bucket], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->totalMicros[phase], micros, __ATOMIC_RELAXED);
+}
+
+// upper edge of the bucket holding the p-th fraction of samples
+static long long percentile(const long long* buckets, long long count, double p){
+	long long seen = 0;
+	int i;
+	for(i = 0; i < STAT_BUCKETS; i++){
+		seen += buckets[i];
+		if(count > 0 && seen >= p * count) return 2LL << i;
+	}
+	return 0;
+}
+
+int statReport(char* buf, int size, const char* name){
+	long long counters[STAT_COUNTERS] = { 0 }, buckets[STAT_PHASES][STAT_BUCKETS], micros[STAT_PHASES] = { 0 }, count;
+	int shardCount = __atomic_load_n(&shardsUsed, __ATOMIC_RELAXED), i, j, k, len;
+
+	memset(buckets, 0, sizeof(buckets));
+	if(shardCount > STAT_SHARDS) shardCount = STAT_SHARDS;
+	for(i = 0; i < shardCount; i++){
+		for(j = 0; j < STAT_COUNTERS; j++){
+			counters[j] += __atomic_load_n(&shards[i].counters[j], __ATOMIC_RELAXED);
+		}
+		for(j = 0; j < STAT_PHASES; j++){
+			micros[j] += __atomic_load_n(&shards[i].totalMicros[j], __ATOMIC_RELAXED);
+			for(k = 0; k < STAT_BUCKETS; k++){
+				buckets[j][k] += __atomic_load_n(&shards[i].buckets[j][k], __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	len = snprintf(buf, size, "{\"daemon\":\"%s\",\"kernel\":\"%s\",\"uptime\":%.1f,"
+		"\"accepted\":%lld,\"active\":%lld,\"rejected\":%lld,\"requests\":%lld,\"encryptions\":%lld,\"decryptions\":%lld,\"errors\":%lld,"
+		"\"bytes_in\":%lld,\"bytes_out\":%lld,\"pool_bytes\":%lld,\"latency_us\":{",
+		name, otpKernelName(), started >= 0 ? statNow() - started : 0.0,
+		counters[STAT_ACCEPTED], counters[STAT_ACTIVE], counters[STAT_REJECTED], counters[STAT_REQUESTS],
+		counters[STAT_ENCRYPTIONS], counters[STAT_DECRYPTIONS],		counters[STAT_ERRORS], counters[STAT_BYTES_IN], counters[STAT_BYTES_OUT],
+		counters[STAT_POOL_BYTES]);
+	for(j = 0; j < STAT_PHASES && len < size; j++){
+		for(k = 0, count = 0; k < STAT_BUCKETS; k++) count += buckets[j][k];
+		len += snprintf(buf + len, size - len, "%s\"%s\":{\"count\":%lld,\"mean\":%.1f,\"p50\":%lld,\"p99\":%lld,\"p999\":%lld,\"buckets\":[",
+			j ? "," : "", phaseNames[j], count, count ? (double)micros[j] / count : 0.0,
+			percentile(buckets[j], count, 0.5), percentile(buckets[j], count, 0.99), percentile(buckets[j], count, 0.999));
+		for(k = 0; k < STAT_BUCKETS && len < size; k++){
+			len += snprintf(buf + len, size - len, "%s%lld", k ? "," : "", buckets[j][k]);
+		}
+		if(len < size) len += snprintf(buf + len, size - len, "]}");
+	}
+	if(len < size) len += snprintf(buf + len, size - len, "}}\n");
+	return len < size ? len : size - 1;
+}
@@ -0,0 +1,43 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_stats.h
+* Description: load counters and per-phase latency histograms for the daemons,
+* read back with a "stats" request on the daemon's own port (otp_enc -S port)
+**********************************************************************************/
+#ifndef OTP_STATS_H
+#define OTP_STATS_H
+
+#define STATS_HANDSHAKE "stats"					// handshake that asks for a report instead of a request
+#define STATS_REPORT_SIZE 8192
+#define STAT_BUCKETS 32							// latency bucket i holds [2^i, 2^(i+1)) microseconds
+
+enum statCounter {
+	STAT_ACCEPTED,								// connections taken on
+	STAT_ACTIVE,								// connections open right now
+	STAT_REJECTED,								// wrong handshake, e.g. otp_dec on otp_enc_d
+	STAT_REQUESTS,								// requests answered in full
+	STAT_ENCRYPTIONS,							// the same, split by operation
+	STAT_DECRYPTIONS,
+	STAT_ERRORS,								// connections dropped part way through a request
+	STAT_BYTES_IN,
+	STAT_BYTES_OUT,
+	STAT_POOL_BYTES,							// payload buffer memory mapped by otp_pool.c
+	STAT_COUNTERS
+};
+
+enum statPhase {
+	PHASE_HANDSHAKE,							// accept until the handshake checks out
+	PHASE_RECEIVE,								// first byte of a request (or chunk) until its key is in
+	PHASE_CIPHER,								// the kernel itself
+	PHASE_SEND,									// answer queued until the last byte is written
+	STAT_PHASES
+};
+
+double statNow(void);											// monotonic seconds
+void statStart(void);											// daemon is up: uptime counts from here
+void statAdd(enum statCounter counter, long long n);
+void statTime(enum statPhase phase, double since);				// record statNow() - since
+int statReport(char* buf, int size, const char* name);			// JSON, returns its length
+
+#endif
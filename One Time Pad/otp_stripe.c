@@ -0,0 +1,103 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_stripe.c
+* Description: stripe pool for the daemons (-s). A large cipher call becomes a
+* job on a shared queue. Helper threads claim stripes from the oldest job first;
+* the caller joins in until its own are all handed out, then waits for the last
+* one to finish. Everything happens under one lock, which is taken once per 64 KiB
+* stripe and so costs nothing next to the ciphering
+**********************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "otp_stripe.h"
+
+struct stripeJob {
+	cipherFunc transform;
+	char* out;
+	const char *in, *key;
+	size_t n;
+	size_t stripes, claimed, finished;
+	size_t firstBad;										// lowest offset outside the alphabet, or n
+	struct stripeJob* next;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;		// a job was queued
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;		// a job's last stripe finished
+static struct stripeJob *head, *tail;
+static int helperCount;
+
+/* Claim the next stripe of the oldest job and run it. Called with the lock held
+   and a job queued; returns with the lock held again */
+static void runStripe(void){
+	struct stripeJob* job = head;
+	size_t i = job->claimed++, start, length, ok;
+
+	if(job->claimed == job->stripes){						// nothing left to hand out
+		head = job->next;
+		if(head == NULL) tail = NULL;
+	}
+	pthread_mutex_unlock(&lock);
+	start = i * STRIPE_SIZE;
+	length = job->n - start < STRIPE_SIZE ? job->n - start : STRIPE_SIZE;
+	ok = job->transform(job->out + start, job->in + start, job->key + start, length);
+	pthread_mutex_lock(&lock);
+	if(ok < length && start + ok < job->firstBad) job->firstBad = start + ok;
+	if(++job->finished == job->stripes) pthread_cond_broadcast(&done);	// the caller may free the job once we unlock
+}
+
+static void* helperThread(void* arg){
+	(void)arg;
+	pthread_mutex_lock(&lock);
+	while(1){
+		while(head == NULL){
+			pthread_cond_wait(&work, &lock);
+		}
+		runStripe();
+	}
+	return NULL;
+}
+
+void stripeStart(int helpers){
+	pthread_t thread;
+	int i;
+	for(i = 0; i < helpers; i++){
+		if(pthread_create(&thread, NULL, helperThread, NULL) != 0){
+			perror("stripeStart");
+			exit(1);
+		}
+		pthread_detach(thread);
+	}
+	helperCount = helpers;
+}
+
+size_t stripeCipher(cipherFunc transform, char* out, const char* in, const char* key, size_t n){
+	struct stripeJob job;
+
+	if(helperCount == 0 || n < 2 * STRIPE_SIZE) return transform(out, in, key, n);
+	job.transform = transform;
+	job.out = out;
+	job.in = in;
+	job.key = key;
+	job.n = n;
+	job.stripes = (n + STRIPE_SIZE - 1) / STRIPE_SIZE;
+	job.claimed = job.finished = 0;
+	job.firstBad = n;
+	job.next = NULL;
+
+	pthread_mutex_lock(&lock);
+	if(tail != NULL) tail->next = &job;
+	else head = &job;
+	tail = &job;
+	pthread_cond_broadcast(&work);
+	while(job.claimed < job.stripes){						// lend a hand, oldest job first, rather than sit idle
+		runStripe();
+	}
+	while(job.finished < job.stripes){
+		pthread_cond_wait(&done, &lock);
+	}
+	pthread_mutex_unlock(&lock);
+	return job.firstBad;
+}
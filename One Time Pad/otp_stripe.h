@@ -0,0 +1,25 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_stripe.h
+* Description: splits one large cipher call into cache-sized stripes and runs
+* them on a pool of helper threads, so a single big request can use more than
+* one core. Each position of a one-time pad only depends on its own text and key
+* char, so the stripes need no coordination beyond counting them done
+**********************************************************************************/
+#ifndef OTP_STRIPE_H
+#define OTP_STRIPE_H
+
+#include <stddef.h>
+#include "otp_daemon.h"
+
+#define STRIPE_SIZE (64 * 1024)					// chars per stripe: text, key and output stay in L2
+
+void stripeStart(int helpers);					// once, before any stripeCipher(); 0 turns striping off
+
+/* transform(out, in, key, n), split over the helpers and the calling thread when
+   n is at least two stripes. Returns like the kernel itself: n, or the first
+   offset outside the alphabet */
+size_t stripeCipher(cipherFunc transform, char* out, const char* in, const char* key, size_t n);
+
+#endif
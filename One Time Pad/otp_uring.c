@@ -0,0 +1,405 @@
+/**********************************************************************************
+* Author: Amy Stockinger
+* Date: 10/17/2026
+* Program: otp_uring.c
+* Description: io_uring engine for the daemons. Like the epoll loops, each loop
+* thread owns its connections and steps their sessions forward, but instead of
+* waiting for readiness and then calling accept/recv/send itself it queues those
+* operations on its ring and collects them as they complete. Everything queued
+* while handling one batch of completions goes to the kernel in the same
+* io_uring_enter() call that waits for the next batch, so a request costs a
+* fraction of a system call instead of several. The ring is driven with the raw
+* system calls, so no liburing is needed, and if the kernel has no io_uring the
+* daemon falls back to its worker pool. A draining loop cancels its accept and
+* ends with its last connection
+**********************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "otp_daemon.h"
+#include "otp_session.h"
+
+#define RING_ENTRIES 256
+#define RING_FLAGS (IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN)	// completions only run when we ask
+
+// what a completion was for, kept in the low bits of its user_data
+enum ringOp {
+	OP_ACCEPT,
+	OP_RECV,
+	OP_SEND,
+	OP_CLOSE,
+	OP_TICK,												// once a second, for the idle sweep
+	OP_CANCEL,												// draining: withdraw the queued accept
+	OP_MASK = 7
+};
+
+struct ringConn {
+	int fd;
+	int dropping;											// shut down for idling, free it when its operation ends
+	time_t lastActive;
+	struct otpSession session;
+	struct msghdr msg;										// memfd mode: the header comes with a descriptor,
+	struct iovec iov[2];									// and an answer goes out as its header and data
+	char control[CMSG_SPACE(sizeof(int))];
+	struct ringConn *prev, *next;
+} __attribute__((aligned(OP_MASK + 1)));
+
+struct ringLoop {
+	const struct daemonConfig* config;
+	int ringFD, enterFD;									// enterFD is the registered index once that works
+	int listenFD;											// this loop's listening socket, see daemonConfig
+	unsigned enterFlags;
+	unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	unsigned sqEntries, tail, toSubmit;						// our copy of the SQ tail, and SQEs not yet handed over
+	int count, limit;										// open connections, and this loop's share of the cap
+	int accepting;											// an accept is queued
+	int cancelling;											// and has been asked to go away
+	struct __kernel_timespec tick;
+	struct ringConn* conns;
+};
+
+static int ringSetup(unsigned entries, struct io_uring_params* params){
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ringEnter(struct ringLoop* loop, unsigned toSubmit, unsigned minComplete){
+	return syscall(__NR_io_uring_enter, loop->enterFD, toSubmit, minComplete,
+		loop->enterFlags | (minComplete > 0 ? IORING_ENTER_GETEVENTS : 0), NULL, 0);
+}
+
+// create the ring and map its queues; -1 with errno set if the kernel says no
+static int openRing(struct ringLoop* loop){
+	struct io_uring_params params;
+	struct io_uring_rsrc_update reg;
+	size_t sqSize, cqSize;
+	char *sq, *cq;
+
+	memset(&params, 0, sizeof(params));
+	params.flags = RING_FLAGS;
+	loop->ringFD = ringSetup(RING_ENTRIES, &params);
+	if(loop->ringFD < 0 && errno == EINVAL){						// older kernel: no deferred task work
+		memset(&params, 0, sizeof(params));
+		loop->ringFD = ringSetup(RING_ENTRIES, &params);
+	}
+	if(loop->ringFD < 0) return -1;
+	if(!(params.features & IORING_FEAT_FAST_POLL) || !(params.features & IORING_FEAT_SINGLE_MMAP)){
+		close(loop->ringFD);										// would park a kernel thread per socket
+		errno = ENOSYS;
+		return -1;
+	}
+
+	sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if(cqSize > sqSize) sqSize = cqSize;
+	sq = mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, loop->ringFD, IORING_OFF_SQ_RING);
+	loop->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, loop->ringFD, IORING_OFF_SQES);
+	if(sq == MAP_FAILED || loop->sqes == MAP_FAILED) return -1;
+	cq = sq;														// one mapping holds both rings
+	loop->sqHead = (unsigned*)(sq + params.sq_off.head);
+	loop->sqTail = (unsigned*)(sq + params.sq_off.tail);
+	loop->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+	loop->sqArray = (unsigned*)(sq + params.sq_off.array);
+	loop->cqHead = (unsigned*)(cq + params.cq_off.head);
+	loop->cqTail = (unsigned*)(cq + params.cq_off.tail);
+	loop->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+	loop->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	loop->sqEntries = params.sq_entries;
+	loop->tail = *loop->sqTail;
+
+	// register the ring's own descriptor, which saves a file lookup on every enter
+	loop->enterFD = loop->ringFD;
+	memset(&reg, 0, sizeof(reg));
+	reg.offset = -1U;
+	reg.data = loop->ringFD;
+	if(syscall(__NR_io_uring_register, loop->ringFD, IORING_REGISTER_RING_FDS, &reg, 1) == 1){
+		loop->enterFD = reg.offset;
+		loop->enterFlags = IORING_ENTER_REGISTERED_RING;
+	}
+	return 0;
+}
+
+// hand everything queued so far to the kernel, and wait for minComplete completions
+static void submit(struct ringLoop* loop, unsigned minComplete){
+	int n;
+	__atomic_store_n(loop->sqTail, loop->tail, __ATOMIC_RELEASE);
+	while(1){
+		n = ringEnter(loop, loop->toSubmit, minComplete);
+		if(n >= 0){
+			loop->toSubmit -= n;
+			return;
+		}
+		if(errno == EINTR) continue;
+		if(errno == EAGAIN || errno == EBUSY){						// completions have to be reaped first
+			if(minComplete > 0) return;
+			continue;
+		}
+		fprintf(stderr, "%s error: io_uring_enter: %s\n", loop->config->service->name, strerror(errno));
+		exit(1);
+	}
+}
+
+// next free submission entry, cleared, with its completion tagged as op for ptr
+static struct io_uring_sqe* queueOp(struct ringLoop* loop, enum ringOp op, void* ptr){
+	struct io_uring_sqe* sqe;
+	unsigned index;
+
+	while(loop->tail - __atomic_load_n(loop->sqHead, __ATOMIC_ACQUIRE) >= loop->sqEntries){
+		submit(loop, 0);											// queue full: let the kernel take some
+	}
+	index = loop->tail & *loop->sqMask;
+	sqe = &loop->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = (uintptr_t)ptr | op;
+	loop->sqArray[index] = index;
+	loop->tail++;
+	loop->toSubmit++;
+	return sqe;
+}
+
+static void queueAccept(struct ringLoop* loop){
+	struct io_uring_sqe* sqe;
+	if(loop->accepting || loop->count >= loop->limit || daemonDraining()) return;	// past the cap the backlog holds new clients
+	sqe = queueOp(loop, OP_ACCEPT, NULL);
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = loop->listenFD;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	loop->accepting = 1;
+}
+
+// draining: the accept still queued would otherwise take one more client
+static void cancelAccept(struct ringLoop* loop){
+	struct io_uring_sqe* sqe;
+	if(!loop->accepting || loop->cancelling) return;
+	sqe = queueOp(loop, OP_CANCEL, NULL);
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->addr = OP_ACCEPT;											// the accept's user_data
+	loop->cancelling = 1;
+}
+
+static void queueTick(struct ringLoop* loop){
+	struct io_uring_sqe* sqe = queueOp(loop, OP_TICK, NULL);
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->addr = (uintptr_t)&loop->tick;
+	sqe->len = 1;
+}
+
+static void closeConn(struct ringLoop* loop, struct ringConn* c){
+	struct io_uring_sqe* sqe = queueOp(loop, OP_CLOSE, NULL);			// closed with the next batch
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = c->fd;
+	sessionFree(&c->session);
+	if(c->prev) c->prev->next = c->next;
+	else loop->conns = c->next;
+	if(c->next) c->next->prev = c->prev;
+	free(c);
+	loop->count--;
+	queueAccept(loop);
+}
+
+/* Queue the connection's next operation: whatever the session has to send, or
+   else room for what it wants to read. Each connection has at most one operation
+   in flight, which keeps the session in lockstep the same way the other engines do */
+static void step(struct ringLoop* loop, struct ringConn* c){
+	struct io_uring_sqe* sqe;
+	char* in;
+	int n;
+
+	if(c->dropping){
+		closeConn(loop, c);
+	}
+	else if((n = sessionSendData(&c->session, c->iov)) > 0){
+		memset(&c->msg, 0, sizeof(c->msg));
+		c->msg.msg_iov = c->iov;
+		c->msg.msg_iovlen = n;
+		sqe = queueOp(loop, OP_SEND, c);
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = c->fd;
+		sqe->addr = (uintptr_t)&c->msg;
+		sqe->len = 1;
+		sqe->msg_flags = MSG_NOSIGNAL;
+	}
+	else if(sessionFinished(&c->session) || (n = sessionRecvSpace(&c->session, &in)) <= 0){
+		closeConn(loop, c);
+	}
+	else if(sessionWantsDescriptor(&c->session)){
+		c->iov[0].iov_base = in;
+		c->iov[0].iov_len = n;
+		memset(&c->msg, 0, sizeof(c->msg));
+		c->msg.msg_iov = c->iov;
+		c->msg.msg_iovlen = 1;
+		c->msg.msg_control = c->control;
+		c->msg.msg_controllen = sizeof(c->control);
+		sqe = queueOp(loop, OP_RECV, c);
+		sqe->opcode = IORING_OP_RECVMSG;
+		sqe->fd = c->fd;
+		sqe->addr = (uintptr_t)&c->msg;
+		sqe->len = 1;
+		sqe->msg_flags = MSG_CMSG_CLOEXEC;
+	}
+	else{
+		c->msg.msg_controllen = 0;									// a plain recv, nothing to pick up
+		sqe = queueOp(loop, OP_RECV, c);
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = c->fd;
+		sqe->addr = (uintptr_t)in;
+		sqe->len = n;
+	}
+}
+
+static void accepted(struct ringLoop* loop, int fd){
+	struct ringConn* c;
+
+	loop->accepting = loop->cancelling = 0;
+	if(fd < 0){
+		if(fd != -EINTR && fd != -ECONNABORTED && fd != -EAGAIN && fd != -ECANCELED){
+			fprintf(stderr, "%s error: on accept: %s\n", loop->config->service->name, strerror(-fd));
+		}
+		if(fd != -EMFILE && fd != -ENFILE) queueAccept(loop);		// out of descriptors: wait for the next tick
+		return;
+	}
+	c = calloc(1, sizeof(*c));
+	if(c == NULL){
+		close(fd);
+		return;
+	}
+	c->fd = fd;
+	c->lastActive = time(NULL);
+	sessionInit(&c->session, loop->config->service, loop->config->pad);
+	c->next = loop->conns;
+	if(c->next) c->next->prev = c;
+	loop->conns = c;
+	loop->count++;
+	step(loop, c);
+	queueAccept(loop);
+}
+
+static void completed(struct ringLoop* loop, struct ringConn* c, enum ringOp op, int res, time_t now){
+	const char* name = loop->config->service->name;
+
+	if(res == -EINTR || res == -EAGAIN){							// nothing happened, try again
+		step(loop, c);
+		return;
+	}
+	if(res < 0){
+		if(!c->dropping){
+			fprintf(stderr, "%s error: %s socket: %s\n", name, op == OP_SEND ? "writing to" : "reading from", strerror(-res));
+		}
+		closeConn(loop, c);
+		return;
+	}
+	c->lastActive = now;
+	if(op == OP_RECV && c->msg.msg_controllen > 0) takeDescriptor(&c->session, &c->msg);
+	if((op == OP_SEND ? sessionSent(&c->session, res) : sessionReceived(&c->session, res)) < 0){
+		closeConn(loop, c);
+		return;
+	}
+	step(loop, c);
+}
+
+/* Shut down connections that have made no progress for idleSeconds. Each one has
+   an operation in flight, which then ends and lets step() close it */
+static void sweepIdle(struct ringLoop* loop, time_t now){
+	struct ringConn* c;
+	for(c = loop->conns; c != NULL; c = c->next){
+		if(!c->dropping && now - c->lastActive > loop->config->idleSeconds){
+			fprintf(stderr, "%s error: reading from socket: client idle too long\n", loop->config->service->name);
+			c->dropping = 1;
+			shutdown(c->fd, SHUT_RDWR);
+		}
+	}
+}
+
+static void* ringLoopThread(void* arg){
+	struct ringLoop* loop = arg;
+	struct io_uring_cqe* cqe;
+	unsigned head, tail;
+	time_t now;
+	enum ringOp op;
+
+	if(loop->ringFD < 0 && openRing(loop) < 0){					// loop 0's ring was opened as the probe
+		fprintf(stderr, "%s error: io_uring_setup: %s\n", loop->config->service->name, strerror(errno));
+		exit(1);
+	}
+	loop->tick.tv_sec = 1;
+	queueTick(loop);
+	queueAccept(loop);
+	while(1){
+		submit(loop, 1);
+		now = time(NULL);
+		head = *loop->cqHead;
+		tail = __atomic_load_n(loop->cqTail, __ATOMIC_ACQUIRE);
+		for(; head != tail; head++){
+			cqe = &loop->cqes[head & *loop->cqMask];
+			op = cqe->user_data & OP_MASK;
+			switch(op){
+				case OP_ACCEPT:
+					accepted(loop, cqe->res);
+					break;
+				case OP_TICK:
+					sweepIdle(loop, now);
+					queueTick(loop);
+					queueAccept(loop);
+					break;
+				case OP_CLOSE:
+				case OP_CANCEL:
+					break;
+				default:
+					completed(loop, (struct ringConn*)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK), op, cqe->res, now);
+			}
+			__atomic_store_n(loop->cqHead, head + 1, __ATOMIC_RELEASE);
+		}
+		if(daemonDraining()){											// the tick brings us here at least once a second
+			cancelAccept(loop);
+			if(loop->count == 0 && !loop->accepting) break;
+		}
+	}
+	loopFinished();
+	return NULL;
+}
+
+void runUringLoops(const struct daemonConfig* config){
+	struct ringLoop* loops = calloc(config->threads, sizeof(struct ringLoop));
+	pthread_t thread;
+	int i;
+
+	if(loops == NULL){
+		perror("runUringLoops");
+		exit(1);
+	}
+	for(i = 0; i < config->threads; i++){
+		loops[i].config = config;
+		loops[i].listenFD = config->listenFDs[i % config->listeners];
+		loops[i].ringFD = -1;
+		loops[i].limit = config->maxInFlight / config->threads;
+		if(loops[i].limit < 1) loops[i].limit = 1;
+	}
+	// loop 0 runs in this thread, so its ring doubles as the check that io_uring works at all
+	if(openRing(&loops[0]) < 0){
+		fprintf(stderr, "%s: io_uring unavailable (%s), using the worker pool\n", config->service->name, strerror(errno));
+		free(loops);
+		return;
+	}
+	for(i = 1; i < config->threads; i++){
+		if(pthread_create(&thread, NULL, ringLoopThread, &loops[i]) != 0){
+			fprintf(stderr, "%s error: starting io_uring loop\n", config->service->name);
+			exit(1);
+		}
+		pthread_detach(thread);
+	}
+	ringLoopThread(&loops[0]);
+}